@@ -2,17 +2,38 @@
 
 // Based on: http://wdobbie.com/post/gpu-text-rendering-with-vector-textures/
 
+const int INTERIOR_RECTANGLE_COUNT = 2;
+
 struct Glyph {
 	int start, count;
+	int rotatedStart, rotatedCount;
+	int bandStart, bandCount;
+	int flags;
+	vec2 min, max;
+	vec4 interior[INTERIOR_RECTANGLE_COUNT]; // (min, max), empty if min > max
 };
 
+const int GLYPH_FLAG_SORTED    = 1;
+const int GLYPH_FLAG_MONOTONIC = 2;
+
+const uint CURVE_FLAG_ASCENDING      = 1u;
+const uint CURVE_FLAG_LINEAR         = 2u;
+const uint CURVE_FLAG_ROTATED_LINEAR = 4u;
+
+const int CURVE_FORMAT_FLOAT     = 0;
+const int CURVE_FORMAT_QUANTIZED = 1;
+const int CURVE_FORMAT_STRIP     = 2;
+const int CURVE_FORMAT_COEFFICIENTS = 3;
+
 struct Curve {
 	vec2 p0, p1, p2;
 };
 
 uniform isamplerBuffer glyphs;
 uniform samplerBuffer curves;
-uniform vec4 color;
+uniform isamplerBuffer bands;
+uniform usamplerBuffer curveFlags;
+uniform int curveFormat = CURVE_FORMAT_FLOAT;
 
 
 // Controls for debugging and exploring:
@@ -29,46 +50,152 @@ uniform bool enableSuperSamplingAntiAliasing = true;
 // Draw control points for debugging (green - on curve, magenta - off curve).
 uniform bool enableControlPointsVisualization = false;
 
+// Only evaluate the curves in the band of the current sample instead of all
+// curves of the glyph.
+uniform bool enableBands = true;
+
+// Return full coverage for pixels inside one of the interior rectangles of
+// the glyph without evaluating any curves.
+uniform bool enableInteriorRectangles = true;
+
+// Visualize the number of curves evaluated per pixel (blue - none, red - 64 or more).
+uniform bool enableCostVisualization = false;
+
 
 in vec2 uv;
 flat in int bufferIndex;
+flat in vec4 glyphColor; // premultiplied
 
 out vec4 result;
 
+// Number of calls to computeCoverage for the current pixel.
+int evaluations = 0;
+
 Glyph loadGlyph(int index) {
 	Glyph result;
-	ivec2 data = texelFetch(glyphs, index).xy;
-	result.start = data.x;
-	result.count = data.y;
+	ivec4 data0 = texelFetch(glyphs, 5*index+0);
+	ivec4 data1 = texelFetch(glyphs, 5*index+1);
+	ivec4 data2 = texelFetch(glyphs, 5*index+2);
+	result.start = data0.x;
+	result.count = data0.y;
+	result.rotatedStart = data0.z;
+	result.rotatedCount = data0.w;
+	result.bandStart = data1.x;
+	result.bandCount = data1.y;
+	result.flags = data1.z;
+	result.min = intBitsToFloat(data2.xy);
+	result.max = intBitsToFloat(data2.zw);
+	for (int i = 0; i < INTERIOR_RECTANGLE_COUNT; i++) {
+		result.interior[i] = intBitsToFloat(texelFetch(glyphs, 5*index+3+i));
+	}
 	return result;
 }
 
-Curve loadCurve(int index) {
+// Loads a single curve. Curves are referenced by their index, except for
+// CURVE_FORMAT_STRIP, where they are referenced by the texel of their start
+// point.
+Curve loadCurve(Glyph glyph, int reference) {
+	int texel = (curveFormat == CURVE_FORMAT_STRIP) ? reference : 3*reference;
+
 	Curve result;
-	result.p0 = texelFetch(curves, 3*index+0).xy;
-	result.p1 = texelFetch(curves, 3*index+1).xy;
-	result.p2 = texelFetch(curves, 3*index+2).xy;
+	result.p0 = texelFetch(curves, texel+0).xy;
+	result.p1 = texelFetch(curves, texel+1).xy;
+	result.p2 = texelFetch(curves, texel+2).xy;
+
+	if (curveFormat == CURVE_FORMAT_COEFFICIENTS) {
+		// The texels hold a, b and c (see computeCoverage).
+		vec2 a = result.p0;
+		vec2 b = result.p1;
+		vec2 c = result.p2;
+		result.p0 = c;
+		result.p1 = c - b;
+		result.p2 = result.p1 - b + a;
+	}
+
+	if (curveFormat == CURVE_FORMAT_QUANTIZED) {
+		// The control points are stored relative to the bounding box of the
+		// glyph and already normalized to [0, 1] by the texture format.
+		vec2 size = glyph.max - glyph.min;
+		result.p0 = glyph.min + size * result.p0;
+		result.p1 = glyph.min + size * result.p1;
+		result.p2 = glyph.min + size * result.p2;
+	}
+
 	return result;
 }
 
-float computeCoverage(float inverseDiameter, vec2 p0, vec2 p1, vec2 p2) {
+// Iterates over consecutive curves. For CURVE_FORMAT_STRIP, the end point of
+// each curve is carried forward as the start point of the next curve, so
+// only two texels have to be fetched per curve (plus two per strip).
+struct CurveIterator {
+	int reference;
+	int remaining; // remaining curves in the current strip
+	Curve curve;
+};
+
+CurveIterator beginCurves(int start) {
+	CurveIterator it;
+	// Positioned before the first curve (see nextCurve).
+	it.reference = start - ((curveFormat == CURVE_FORMAT_STRIP) ? 3 : 1);
+	it.remaining = 0;
+	return it;
+}
+
+// Advances to the next curve. Afterwards, it.curve holds the curve and
+// it.reference can be used with loadCurve and to fetch its flags.
+void nextCurve(inout CurveIterator it, Glyph glyph) {
+	if (curveFormat != CURVE_FORMAT_STRIP) {
+		it.reference++;
+		it.curve = loadCurve(glyph, it.reference);
+		return;
+	}
+
+	if (it.remaining == 0) {
+		// Each strip starts with a header holding its number of curves,
+		// followed by the start point of the first curve. The header
+		// directly follows the end point of the previous strip.
+		int header = it.reference + 3;
+		it.remaining = int(texelFetch(curves, header).x);
+		it.curve.p2 = texelFetch(curves, header+1).xy;
+		it.reference = header + 1;
+	} else {
+		it.reference += 2;
+	}
+
+	it.curve.p0 = it.curve.p2;
+	it.curve.p1 = texelFetch(curves, it.reference+1).xy;
+	it.curve.p2 = texelFetch(curves, it.reference+2).xy;
+	it.remaining--;
+}
+
+// The coefficients a and b are passed in addition to the control points,
+// because they are either computed once per curve by the caller or loaded
+// directly (CURVE_FORMAT_COEFFICIENTS). The coefficient c is p0.
+float computeCoverage(float inverseDiameter, vec2 p0, vec2 p1, vec2 p2, vec2 a, vec2 b, bool linear) {
 	if (p0.y > 0 && p1.y > 0 && p2.y > 0) return 0.0;
 	if (p0.y < 0 && p1.y < 0 && p2.y < 0) return 0.0;
 
 	// Note: Simplified from abc formula by extracting a factor of (-2) from b.
-	vec2 a = p0 - 2*p1 + p2;
-	vec2 b = p0 - p1;
 	vec2 c = p0;
 
 	float t0, t1;
-	if (abs(a.y) >= 1e-5) {
+	if (!linear) {
 		// Quadratic segment, solve abc formula to find roots.
 		float radicand = b.y*b.y - a.y*c.y;
 		if (radicand <= 0) return 0.0;
 	
+		// One of the roots is computed using the alternative form c / (b ± s)
+		// of the quadratic formula to avoid cancellation if a.y is small
+		// (e.g. for quantized line segments, whose middle control point is
+		// not exactly at the midpoint).
 		float s = sqrt(radicand);
-		t0 = (b.y - s) / a.y;
-		t1 = (b.y + s) / a.y;
+		if (b.y >= 0) {
+			t0 = c.y / (b.y + s);
+			t1 = (b.y + s) / a.y;
+		} else {
+			t0 = (b.y - s) / a.y;
+			t1 = c.y / (b.y - s);
+		}
 	} else {
 		// Linear segment, avoid division by a.y, which is near zero.
 		// There is only one root, so we have to decide which variable to
@@ -100,10 +227,140 @@ float computeCoverage(float inverseDiameter, vec2 p0, vec2 p1, vec2 p2) {
 	return alpha;
 }
 
+// Variant of computeCoverage for curves that are monotonic in y, which can
+// intersect the ray at most once. The direction of the curve is known in
+// advance (ascending - entry, descending - exit).
+float computeMonotonicCoverage(float inverseDiameter, vec2 p0, vec2 p2, vec2 a, vec2 b, bool ascending) {
+	// Count an intersection with the lower end point but not with the upper
+	// one, so that curves meeting on the ray are handled consistently.
+	if (min(p0.y, p2.y) > 0 || max(p0.y, p2.y) <= 0) return 0.0;
+
+	vec2 c = p0;
+
+	// Alternative form of the quadratic formula, which selects the root in
+	// the direction of the curve (see readme) and also works for linear
+	// segments (a.y = 0). The denominator is only zero if the curve starts
+	// on the ray with a horizontal tangent, in which case c.y = 0 as well.
+	float direction = ascending ? 1.0 : -1.0;
+	float s = sqrt(max(b.y*b.y - a.y*c.y, 0.0));
+	float denominator = b.y - direction * s;
+	float t = (denominator != 0.0) ? c.y / denominator : 0.0;
+
+	float x = (a.x*t - 2.0*b.x)*t + c.x;
+	return -direction * clamp(x * inverseDiameter + 0.5, 0, 1);
+}
+
 vec2 rotate(vec2 v) {
 	return vec2(v.y, -v.x);
 }
 
+// Computes the coverage along the ray parallel to the x-axis or, if rotated
+// is true, along the ray parallel to the y-axis.
+float computeRayCoverage(Glyph glyph, bool rotated, float inverseDiameter) {
+	int start = rotated ? glyph.rotatedStart : glyph.start;
+	int count = rotated ? glyph.rotatedCount : glyph.count;
+	int list = -1;
+
+	bool sorted = (glyph.flags & GLYPH_FLAG_SORTED) != 0;
+	bool monotonic = (glyph.flags & GLYPH_FLAG_MONOTONIC) != 0;
+
+	if (enableBands && glyph.bandCount > 0) {
+		// The ray along the x-axis only intersects curves from the horizontal
+		// band containing the sample, the ray along the y-axis only those from
+		// the vertical band. The headers of the horizontal bands come first.
+		float position = rotated ? uv.x : uv.y;
+		float lo = rotated ? glyph.min.x : glyph.min.y;
+		float hi = rotated ? glyph.max.x : glyph.max.y;
+		int band = clamp(int((position - lo) / (hi - lo) * float(glyph.bandCount)), 0, glyph.bandCount - 1);
+		int header = glyph.bandStart + 2 * ((rotated ? glyph.bandCount : 0) + band);
+		list = glyph.bandStart + texelFetch(bands, header+0).x;
+		count = texelFetch(bands, header+1).x;
+	}
+
+	float alpha = 0;
+	CurveIterator it = beginCurves(start);
+	for (int i = 0; i < count; i++) {
+		int reference;
+		vec2 p0, p1, p2, a, b;
+		bool linear;
+
+		if (curveFormat == CURVE_FORMAT_COEFFICIENTS) {
+			reference = start + ((list >= 0) ? texelFetch(bands, list + i).x : i);
+			a = texelFetch(curves, 3*reference+0).xy;
+			b = texelFetch(curves, 3*reference+1).xy;
+			p0 = texelFetch(curves, 3*reference+2).xy - uv;
+
+			uint flags = texelFetch(curveFlags, reference).x;
+			linear = (flags & (rotated ? CURVE_FLAG_ROTATED_LINEAR : CURVE_FLAG_LINEAR)) != 0u;
+
+			if (rotated) {
+				a = rotate(a);
+				b = rotate(b);
+				p0 = rotate(p0);
+			}
+
+			// The remaining control points are only needed for the bounds
+			// checks, so the compiler can drop unused components.
+			p1 = p0 - b;
+			p2 = p1 - b + a;
+		} else {
+			// Curves within a band are loaded individually, because they are
+			// not consecutive in the curve buffer.
+			Curve curve;
+			if (list >= 0) {
+				reference = start + texelFetch(bands, list + i).x;
+				curve = loadCurve(glyph, reference);
+			} else {
+				nextCurve(it, glyph);
+				reference = it.reference;
+				curve = it.curve;
+			}
+
+			p0 = curve.p0 - uv;
+			p1 = curve.p1 - uv;
+			p2 = curve.p2 - uv;
+
+			if (rotated) {
+				p0 = rotate(p0);
+				p1 = rotate(p1);
+				p2 = rotate(p2);
+			}
+
+			a = p0 - 2*p1 + p2;
+			b = p0 - p1;
+			linear = abs(a.y) < 1e-5;
+		}
+
+		// Sorted curves are ordered by descending maximum x-coordinate (after
+		// rotation), so if this curve lies completely behind the
+		// anti-aliasing window, all remaining curves do as well.
+		if (sorted && max(max(p0.x, p1.x), p2.x) * inverseDiameter + 0.5 <= 0.0) break;
+
+		if (monotonic) {
+			bool ascending = (texelFetch(curveFlags, reference).x & CURVE_FLAG_ASCENDING) != 0u;
+			alpha += computeMonotonicCoverage(inverseDiameter, p0, p2, a, b, ascending);
+		} else {
+			alpha += computeCoverage(inverseDiameter, p0, p1, p2, a, b, linear);
+		}
+		evaluations++;
+	}
+
+	return alpha;
+}
+
+// Checks whether the anti-aliasing window around the sample lies completely
+// inside one of the interior rectangles. In that case, all curves are farther
+// away than half the window along both rays, so the coverage is exactly 1.
+bool isInterior(Glyph glyph, vec2 margin) {
+	for (int i = 0; i < INTERIOR_RECTANGLE_COUNT; i++) {
+		vec4 rectangle = glyph.interior[i];
+		if (all(greaterThanEqual(uv - margin, rectangle.xy)) && all(lessThanEqual(uv + margin, rectangle.zw))) {
+			return true;
+		}
+	}
+	return false;
+}
+
 void main() {
 	float alpha = 0;
 
@@ -111,32 +368,33 @@ void main() {
 	vec2 inverseDiameter = 1.0 / (antiAliasingWindowSize * fwidth(uv));
 
 	Glyph glyph = loadGlyph(bufferIndex);
-	for (int i = 0; i < glyph.count; i++) {
-		Curve curve = loadCurve(glyph.start + i);
-
-		vec2 p0 = curve.p0 - uv;
-		vec2 p1 = curve.p1 - uv;
-		vec2 p2 = curve.p2 - uv;
 
-		alpha += computeCoverage(inverseDiameter.x, p0, p1, p2);
+	if (enableInteriorRectangles && isInterior(glyph, 0.5 * antiAliasingWindowSize * fwidth(uv))) {
+		alpha = 1.0;
+	} else {
+		alpha += computeRayCoverage(glyph, false, inverseDiameter.x);
 		if (enableSuperSamplingAntiAliasing) {
-			alpha += computeCoverage(inverseDiameter.y, rotate(p0), rotate(p1), rotate(p2));
+			alpha += computeRayCoverage(glyph, true, inverseDiameter.y);
+			alpha *= 0.5;
 		}
 	}
 
-	if (enableSuperSamplingAntiAliasing) {
-		alpha *= 0.5;
-	}
-
 	alpha = clamp(alpha, 0.0, 1.0);
-	result = color * alpha;
+	result = glyphColor * alpha;
+
+	if (enableCostVisualization) {
+		float cost = clamp(float(evaluations) / 64.0, 0.0, 1.0);
+		result = 0.5 * vec4(cost, 0.0, 1.0 - cost, 1.0) + 0.5 * result;
+	}
 
 	if (enableControlPointsVisualization) {
 		// Visualize control points.
 		vec2 fw = fwidth(uv);
 		float r = 4.0 * 0.5 * (fw.x + fw.y);
+		CurveIterator it = beginCurves(glyph.start);
 		for (int i = 0; i < glyph.count; i++) {
-			Curve curve = loadCurve(glyph.start + i);
+			nextCurve(it, glyph);
+			Curve curve = it.curve;
 
 			vec2 p0 = curve.p0 - uv;
 			vec2 p1 = curve.p1 - uv;
@@ -4,15 +4,113 @@ uniform mat4 projection;
 uniform mat4 view;
 uniform mat4 model;
 
+// Size of the viewport in pixels.
+uniform vec2 viewportSize;
+
+// Size of one em in model space (see Font::worldSize).
+uniform float worldSize;
+
+// Same as in the fragment shader.
+uniform float antiAliasingWindowSize = 1.0;
+
+// Upper limit for the dilation in em units, which would otherwise grow
+// without bounds at grazing angles.
+uniform float maxDilation = 1.0;
+
+// Additional expansion of the glyph quads in em units (see Font::dilation).
+uniform float quadDilation = 0.0;
+
+// Draw one quad per instance, which is built from the bounding box of the
+// glyph in the glyph buffer (see Font::BufferInstance). Otherwise, the
+// vertices are given explicitly (see Font::BufferVertex).
+uniform bool instanced = false;
+
+// Take the color and an additional model transform of each glyph from the
+// batch attributes instead of the uniforms (see TextBatch). The transforms
+// are stored as four columns per matrix.
+uniform bool batched = false;
+uniform samplerBuffer transforms;
+
+// Premultiplied color of the text, unless batched is set.
+uniform vec4 color;
+
+uniform isamplerBuffer glyphs;
+
 layout (location = 0) in vec2 vertexPosition;
 layout (location = 1) in vec2 vertexUV;
 layout (location = 2) in int  vertexIndex;
+layout (location = 3) in vec2 vertexNormal;
+
+layout (location = 4) in vec2  instancePosition;
+layout (location = 5) in int   instanceIndex;
+layout (location = 6) in float instanceScale;
+
+layout (location = 7) in vec4 batchColor;
+layout (location = 8) in int  batchTransform;
 
 out vec2 uv;
 flat out int bufferIndex;
+flat out vec4 glyphColor;
 
 void main() {
-	gl_Position = projection * view * model * vec4(vertexPosition, 0, 1);
-	uv = vertexUV;
-	bufferIndex = vertexIndex;
+	vec2 modelPosition = vertexPosition;
+	vec2 glyphUV = vertexUV;
+	int glyphIndex = vertexIndex;
+	vec2 normal = vertexNormal;
+	float scale = worldSize;
+
+	if (instanced) {
+		// Corners of the quad in the order of a triangle strip.
+		vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+		ivec4 bounds = texelFetch(glyphs, 5*instanceIndex+2);
+		vec2 boundsMin = intBitsToFloat(bounds.xy);
+		vec2 boundsMax = intBitsToFloat(bounds.zw);
+
+		normal = 2.0 * corner - 1.0;
+		glyphUV = mix(boundsMin, boundsMax, corner) + quadDilation * normal;
+		modelPosition = instancePosition + instanceScale * glyphUV;
+		glyphIndex = instanceIndex;
+		scale = instanceScale;
+	}
+
+	mat4 mvp = projection * view * model;
+	glyphColor = color;
+
+	if (batched) {
+		mat4 transform = mat4(
+			texelFetch(transforms, 4*batchTransform+0),
+			texelFetch(transforms, 4*batchTransform+1),
+			texelFetch(transforms, 4*batchTransform+2),
+			texelFetch(transforms, 4*batchTransform+3));
+		mvp = mvp * transform;
+		glyphColor = batchColor;
+	}
+	vec4 position = mvp * vec4(modelPosition, 0, 1);
+
+	// Jacobian of the mapping from uv (em units) to window coordinates (in
+	// pixels) at this vertex, derived from the perspective division.
+	vec4 dx = mvp[0] * scale;
+	vec4 dy = mvp[1] * scale;
+	float w = position.w;
+	vec2 jx = (dx.xy * w - position.xy * dx.w) / (w * w) * 0.5 * viewportSize;
+	vec2 jy = (dy.xy * w - position.xy * dy.w) / (w * w) * 0.5 * viewportSize;
+
+	// Smallest singular value of the Jacobian, i.e. the smallest number of
+	// pixels covered by one em in any direction.
+	float t = dot(jx, jx) + dot(jy, jy);
+	float d = abs(jx.x * jy.y - jx.y * jy.x);
+	float maxScale = sqrt(0.5 * (t + sqrt(max(t * t - 4.0 * d * d, 0.0))));
+	float minScale = d / max(maxScale, 1e-20);
+
+	// The fragment shader blends over antiAliasingWindowSize times fwidth(uv),
+	// which is at most sqrt(2) times the size of a pixel in uv units. Half of
+	// this window lies outside the outline. The normal moves all adjacent
+	// edges of the glyph geometry outwards by one unit.
+	float dilation = 0.5 * antiAliasingWindowSize * sqrt(2.0) / max(minScale, 1e-20);
+	dilation = (w > 0.0) ? min(dilation, maxDilation) : 0.0;
+
+	vec2 offset = dilation * normal;
+	gl_Position = mvp * vec4(modelPosition + scale * offset, 0, 1);
+	uv = glyphUV + offset;
+	bufferIndex = glyphIndex;
 }
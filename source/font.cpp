@@ -3,7 +3,130 @@
 // but it is still compiled in the "main.cpp" translation unit,
 // because both files have mostly the same dependencies (OpenGL, GLM, FreeType).
 
-class Font {
+// Map from small, dense uint32_t keys to values, which are stored
+// contiguously in insertion order (erasing moves the last entry into the
+// gap). Used for Unicode code points and for glyph indices. The index of the
+// entry for a key is found without hashing: keys below 256 use a direct
+// array, all others a two-level page table with 256 entries per page, where
+// pages are only allocated when one of their keys is inserted. This is
+// faster than std::unordered_map in the layout loop, where most lookups hit
+// the same few pages.
+template <typename T>
+class DenseMap {
+public:
+	using Entry = std::pair<uint32_t, T>;
+
+	DenseMap() {
+		std::fill(std::begin(firstPage), std::end(firstPage), -1);
+	}
+
+	T* find(uint32_t key) {
+		int32_t index = findIndex(key);
+		return (index < 0) ? nullptr : &entries[index].second;
+	}
+
+	const T* find(uint32_t key) const {
+		int32_t index = findIndex(key);
+		return (index < 0) ? nullptr : &entries[index].second;
+	}
+
+	// Inserts a default-constructed value if there is no entry for the key.
+	// The page table grows up to the largest inserted key, so keys should
+	// be bounded (code points are at most 0x10FFFF, glyph indices at most
+	// 0xFFFF).
+	T& operator[](uint32_t key) {
+		int32_t* slot = findOrCreateSlot(key);
+		if (*slot < 0) {
+			*slot = static_cast<int32_t>(entries.size());
+			entries.push_back(Entry(key, T()));
+		}
+		return entries[*slot].second;
+	}
+
+	void erase(uint32_t key) {
+		int32_t* slot = findSlot(key);
+		if (!slot || *slot < 0) return;
+
+		int32_t index = *slot;
+		*slot = -1;
+
+		if (index + 1 != static_cast<int32_t>(entries.size())) {
+			entries[index] = std::move(entries.back());
+			*findSlot(entries[index].first) = index;
+		}
+		entries.pop_back();
+	}
+
+	size_t size() const {
+		return entries.size();
+	}
+
+	typename std::vector<Entry>::iterator begin() { return entries.begin(); }
+	typename std::vector<Entry>::iterator end() { return entries.end(); }
+	typename std::vector<Entry>::const_iterator begin() const { return entries.begin(); }
+	typename std::vector<Entry>::const_iterator end() const { return entries.end(); }
+
+	size_t pageCount() const {
+		size_t count = 0;
+		for (const auto& page : pages) {
+			if (page) count++;
+		}
+		return count;
+	}
+
+	size_t allocatedBytes() const {
+		return sizeof(Entry) * entries.capacity()
+			+ sizeof(std::unique_ptr<int32_t[]>) * pages.capacity()
+			+ sizeof(int32_t) * pageSize * pageCount();
+	}
+
+private:
+	enum { pageSize = 256 };
+
+	int32_t findIndex(uint32_t key) const {
+		if (key < pageSize) return firstPage[key];
+
+		uint32_t page = key / pageSize;
+		if (page >= pages.size() || !pages[page]) return -1;
+		return pages[page][key % pageSize];
+	}
+
+	int32_t* findSlot(uint32_t key) {
+		if (key < pageSize) return &firstPage[key];
+
+		uint32_t page = key / pageSize;
+		if (page >= pages.size() || !pages[page]) return nullptr;
+		return &pages[page][key % pageSize];
+	}
+
+	int32_t* findOrCreateSlot(uint32_t key) {
+		if (key < pageSize) return &firstPage[key];
+
+		uint32_t page = key / pageSize;
+		if (page >= pages.size()) pages.resize(page + 1);
+		if (!pages[page]) {
+			pages[page].reset(new int32_t[pageSize]);
+			std::fill(pages[page].get(), pages[page].get() + pageSize, -1);
+		}
+		return &pages[page][key % pageSize];
+	}
+
+	std::vector<Entry> entries;
+	int32_t firstPage[pageSize]; // indices into entries for keys below 256 (-1 if missing)
+	std::vector<std::unique_ptr<int32_t[]>> pages; // same for all other keys, indexed by key / 256
+};
+
+// Glyph data of a font face that does not depend on the size of the text:
+// the CPU-side buffers, the GPU buffers and textures used by the font shader
+// and the glyph metrics. Without hinting, the outlines are normalized by the
+// size of the em square, so a single store can be shared by any number of
+// Font instances with different sizes (see Font). With hinting, the outlines
+// depend on the size in pixels, which is fixed for a store. A hinted store
+// creates a store for each other size that its Fonts use instead (see
+// getHintedStore).
+class GlyphStore : public std::enable_shared_from_this<GlyphStore> {
+	friend class Font;
+
 	struct Glyph {
 		FT_UInt index;
 		int32_t bufferIndex;
@@ -15,22 +138,292 @@ class Font {
 		FT_Pos bearingX;
 		FT_Pos bearingY;
 		FT_Pos advance;
+
+		// Convex polygon around the outline in polygonVertices (see
+		// computeBoundingPolygon). Empty if the quad from the metrics is
+		// used instead.
+		int32_t polygonStart, polygonCount;
+
+		// Frame in which the glyph was last prepared or drawn (see endFrame).
+		uint64_t lastUsed;
+	};
+
+	// CPU-side information about each entry of bufferGlyphs, which is needed
+	// to evict and move the data of a glyph (see evictGlyphs and compact).
+	// The data of each glyph is contiguous in each buffer and in the same
+	// order as bufferGlyphs.
+	struct GlyphSlot {
+		FT_UInt glyphIndex;
+		bool live;
+		int32_t curveBegin, curveEnd;     // range in the curve buffer (see curveBufferSize)
+		int32_t bandBegin, bandEnd;       // range in bufferBands
+		int32_t polygonBegin, polygonEnd; // range in polygonVertices
+	};
+
+	enum GlyphFlags : int32_t {
+		GLYPH_FLAG_SORTED    = 1 << 0, // see sortCurves
+		GLYPH_FLAG_MONOTONIC = 1 << 1, // see splitMonotonic
+	};
+
+	enum CurveFlags : uint8_t {
+		CURVE_FLAG_ASCENDING      = 1 << 0, // y-coordinate increases from p0 to p2 (see appendCurves)
+		CURVE_FLAG_LINEAR         = 1 << 1, // linear in y, only for CurveFormat::COEFFICIENTS
+		CURVE_FLAG_ROTATED_LINEAR = 1 << 2, // linear in x, only for CurveFormat::COEFFICIENTS
+	};
+
+	// Number of interior rectangles stored for each glyph. Keep in sync with
+	// the shader.
+	enum { INTERIOR_RECTANGLE_COUNT = 2 };
+
+	struct BufferRectangle {
+		float minX, minY, maxX, maxY;
 	};
 
 	struct BufferGlyph {
-		int32_t start, count; // range of bezier curves belonging to this glyph
+		// Ranges of bezier curves belonging to this glyph. The first range is
+		// used for the ray along the x-axis and the second range for the ray
+		// along the y-axis. Both ranges are identical unless the curves are
+		// stored in a different order for each ray.
+		int32_t start, count;
+		int32_t rotatedStart, rotatedCount;
+		int32_t bandStart, bandCount; // bands of this glyph in bufferBands (see buildBands)
+		int32_t flags, padding;
+		float minX, minY, maxX, maxY; // bounding box of the control points
+
+		// Rectangles that are completely inside the glyph (see
+		// computeInteriorRectangles). Unused rectangles are empty (min > max).
+		BufferRectangle interior[INTERIOR_RECTANGLE_COUNT];
 	};
 
 	struct BufferCurve {
 		float x0, y0, x1, y1, x2, y2;
 	};
 
-	struct BufferVertex {
-		float   x, y, u, v;
-		int32_t bufferIndex;
+	// Control points as normalized 16-bit integers relative to the bounding
+	// box of the glyph (see CurveFormat::QUANTIZED).
+	struct BufferQuantizedCurve {
+		uint16_t x0, y0, x1, y1, x2, y2;
+	};
+
+	// Single texel of a curve strip (see CurveFormat::STRIP).
+	struct BufferPoint {
+		float x, y;
+	};
+
+	// Allocated size and size of the data that is already uploaded (in
+	// bytes) of a GPU buffer (see uploadBuffer).
+	struct UploadState {
+		size_t capacity = 0;
+		size_t uploaded = 0;
+
+		// Range within the uploaded data that was modified since the last
+		// upload (empty if dirtyBegin >= dirtyEnd).
+		size_t dirtyBegin = std::numeric_limits<size_t>::max();
+		size_t dirtyEnd = 0;
+
+		void markDirty(size_t begin, size_t end) {
+			dirtyBegin = std::min(dirtyBegin, begin);
+			dirtyEnd = std::max(dirtyEnd, end);
+		}
 	};
 
 public:
+	// Storage format of the curves in the curve buffer. Keep in sync with the
+	// CURVE_FORMAT constants in the shader.
+	enum class CurveFormat {
+		// Control points as 32-bit floats (GL_RG32F, 24 bytes per curve).
+		FLOAT = 0,
+
+		// Control points as normalized 16-bit integers relative to the
+		// bounding box of the glyph (GL_RG16, 12 bytes per curve).
+		QUANTIZED = 1,
+
+		// Control points as 32-bit floats (GL_RG32F), but consecutive
+		// curves that share an end point are stored as a strip of points
+		// (16 bytes per curve plus 16 bytes per strip, see appendCurves).
+		STRIP = 2,
+
+		// Coefficients of the polynomial p(t) = a*t^2 - 2*b*t + c instead
+		// of the control points (GL_RG32F, 24 bytes per curve), where
+		// a = p0 - 2*p1 + p2, b = p0 - p1 and c = p0. Whether a curve is
+		// linear along either axis is precomputed as well, so that the
+		// shader does not have to derive this for every pixel.
+		COEFFICIENTS = 3,
+	};
+
+	// Maximum number of quadratic curves a cubic curve is converted to (see
+	// convertCubic).
+	enum { MAX_CUBIC_PIECES = 16 };
+
+	// Options controlling how glyphs are converted into the buffers used by
+	// the font shader. They are fixed for the lifetime of a GlyphStore.
+	struct Options {
+		// Number of horizontal and vertical bands per glyph. The shader only
+		// evaluates the curves overlapping the band of the current sample.
+		// Zero disables banding.
+		int bandCount = 8;
+
+		// Store the curves of each glyph sorted by their maximum coordinate
+		// (see sortCurves), so that the shader can stop early. This requires
+		// a second copy of the curves for the ray along the y-axis.
+		bool sortCurves = false;
+
+		// Split the curves of each glyph into pieces that intersect the ray
+		// at most once (see splitMonotonic), so that the shader can use a
+		// simpler intersection test. This increases the number of curves and
+		// requires a second copy of the curves for the ray along the y-axis.
+		bool splitMonotonic = false;
+
+		CurveFormat curveFormat = CurveFormat::FLOAT;
+
+		// Store up to INTERIOR_RECTANGLE_COUNT rectangles per glyph that are
+		// completely inside the glyph, so that the shader can skip the
+		// curves for pixels inside them (see computeInteriorRectangles).
+		bool interiorRectangles = true;
+
+		// Draw a convex polygon with at most maxPolygonVertices vertices
+		// around the outline of each glyph instead of the quad from the glyph
+		// metrics to reduce the number of fragments without coverage.
+		bool tightGeometry = false;
+		int maxPolygonVertices = 8;
+
+		// Maximum distance (in em units) between a cubic bezier curve and
+		// its quadratic approximation (see convertCubic). Zero always uses
+		// two quadratic curves per cubic curve. Not met by curves that would
+		// need more than MAX_CUBIC_PIECES quadratic curves.
+		float cubicTolerance = 0.0f;
+
+		// Budgets for the number of glyphs and the size of the curve buffer
+		// (in the units of curveBufferSize). If a budget is exceeded, the
+		// least recently used glyphs are evicted in endFrame. Glyphs used in
+		// the current frame are never evicted, so the budgets can be
+		// exceeded temporarily. Zero means unlimited.
+		int64_t glyphBudget = 0;
+		int64_t curveBudget = 0;
+
+		// Number of glyphs moved per frame by the incremental compaction of
+		// the buffers after glyphs were evicted (see compact).
+		int compactionGlyphsPerFrame = 64;
+
+		// Remove degenerate curves and merge consecutive collinear line
+		// segments of each contour (see simplifyContour).
+		bool simplifyCurves = true;
+
+		// Build the glyphs of the printable ASCII characters when the store
+		// is created. Otherwise, glyphs are only built when they are needed
+		// (see prepareGlyphsForText and getGlyph).
+		bool preloadAscii = true;
+
+		// Number of other pixel sizes for which a hinted store keeps the
+		// glyphs while no Font uses them (see getHintedStore).
+		int hintedSizeCacheCapacity = 4;
+	};
+
+	// Counters describing the glyphs built by a GlyphStore, which include
+	// glyphs that were evicted since (see getMemoryStatistics for the
+	// current contents of the buffers).
+	struct Statistics {
+		int64_t glyphCount = 0;
+		int64_t curveCount = 0;     // number of curves built
+		int64_t rayCount = 0;       // number of non-empty glyphs times two (one for each direction)
+		int64_t rayCurveCount = 0;  // sum of the number of curves for each ray without bands
+		int64_t bandCount = 0;      // total over all glyphs and both directions
+		int64_t bandCurveCount = 0; // sum of the number of curves in each band
+
+		// Number of cubic bezier curves in the outlines and number of
+		// quadratic curves they were converted to. Cubic curves that need
+		// more than MAX_CUBIC_PIECES pieces to meet the tolerance are
+		// counted in clampedCubicCount and exceed it (see convertCubic).
+		int64_t cubicCount = 0;
+		int64_t cubicQuadraticCount = 0;
+		int64_t clampedCubicCount = 0;
+
+		// Number of evicted glyphs and number of glyphs moved by the
+		// compaction of the buffers.
+		int64_t evictedGlyphCount = 0;
+		int64_t movedGlyphCount = 0;
+
+		// Number of curves removed by simplifyContour.
+		int64_t degenerateCurveCount = 0; // start point equals end point
+		int64_t mergedCurveCount = 0;     // merged into a collinear neighbor
+
+		// Total area of the bounding boxes and the interior rectangles of
+		// all glyphs (in squared world units).
+		double boundingBoxArea = 0.0;
+		double interiorArea = 0.0;
+
+		// Total area of the outlines, the quads from the glyph metrics and
+		// the bounding polygons of all glyphs (in squared em units, without
+		// dilation). The ratio between the outline area and the other two
+		// is the fraction of rasterized fragments with coverage. Only
+		// collected with Options::tightGeometry.
+		double outlineArea = 0.0;
+		double quadArea = 0.0;
+		double polygonArea = 0.0;
+
+		// Largest distance between a control point and its stored
+		// representation (in em units, only for CurveFormat::QUANTIZED).
+		float maxQuantizationError = 0.0f;
+	};
+
+	// Current memory usage of a store (see getMemoryStatistics). Unlike
+	// Statistics, which accumulates over all glyphs that were built, this
+	// only describes the glyphs that are currently resident. All sizes are in
+	// bytes.
+	struct MemoryStatistics {
+		int64_t glyphCount = 0; // glyphs in the glyphs map
+		int64_t curveCount = 0; // curves of these glyphs
+
+		// Entries of bufferGlyphs, including evicted glyphs that were not
+		// yet removed by the compaction.
+		int64_t bufferGlyphCount = 0;
+
+		// Size of the data in the CPU-side buffers.
+		int64_t glyphBytes = 0;     // bufferGlyphs
+		int64_t curveBytes = 0;     // curve buffer of the current format
+		int64_t bandBytes = 0;      // bufferBands
+		int64_t curveFlagBytes = 0; // bufferCurveFlags
+		int64_t polygonBytes = 0;   // polygonVertices
+
+		// Memory allocated for the CPU-side buffers, the maps of glyphs and
+		// kerning pairs and the character map (including unused capacity and
+		// an estimate for the nodes and buckets of the kerning map). The
+		// character map may be shared with other stores.
+		int64_t cpuAllocatedBytes = 0;
+
+		// Allocated size of the buffer objects (see uploadBuffer).
+		int64_t gpuGlyphBytes = 0;
+		int64_t gpuCurveBytes = 0;
+		int64_t gpuBandBytes = 0;
+		int64_t gpuCurveFlagBytes = 0;
+		int64_t gpuAllocatedBytes = 0;
+
+		// Glyph with the most curves (zero if there are no curves).
+		FT_UInt largestGlyphIndex = 0;
+		int64_t largestGlyphCurveCount = 0;
+
+		// Number of entries and of allocated pages of the glyphs map (see
+		// DenseMap).
+		int64_t glyphTableSize = 0;
+		int64_t glyphTablePageCount = 0;
+
+		// Number of pairs of resident glyphs with kerning (see
+		// addKerningPairs).
+		int64_t kerningPairCount = 0;
+
+		// Number of charcodes in the snapshot of the character map (see
+		// getGlyphIndex).
+		int64_t characterMapSize = 0;
+
+		// Number of glBufferData/glBufferSubData calls and the number of
+		// bytes they transferred, in the last frame completed by endFrame and
+		// in total.
+		int64_t lastFrameUploadCount = 0;
+		int64_t lastFrameUploadBytes = 0;
+		int64_t totalUploadCount = 0;
+		int64_t totalUploadBytes = 0;
+	};
+
 	static FT_Face loadFace(FT_Library library, const std::string& filename, std::string& error) {
 		FT_Face face = NULL;
 
@@ -58,16 +451,23 @@ public:
 		return face;
 	}
 
-	// If hinting is enabled, worldSize must be an integer and defines the font size in pixels used for hinting.
-	// Otherwise, worldSize can be an arbitrary floating-point value.
-	Font(FT_Face face, float worldSize = 1.0f, bool hinting = false) : face(face), worldSize(worldSize), hinting(hinting) {
+	// If hintingSize is zero, hinting is disabled and the store can be used
+	// for Fonts of any size. Otherwise, hintingSize must be an integer and
+	// defines the font size in pixels used for hinting. The store takes
+	// ownership of the face (use FT_Reference_Face to create several stores
+	// for one face).
+	GlyphStore(FT_Face face, const Options& options, float hintingSize = 0.0f) : face(face), hinting(hintingSize > 0.0f), pixelSize(hintingSize), options(options) {
 
 		if (hinting) {
 			loadFlags = FT_LOAD_NO_BITMAP;
 			kerningMode = FT_KERNING_DEFAULT;
 
-			emSize = worldSize * 64;
-			FT_Error error = FT_Set_Pixel_Sizes(face, 0, static_cast<FT_UInt>(std::ceil(worldSize)));
+			// Each hinted store has its own size object, so that stores of
+			// different sizes can share the face.
+			emSize = pixelSize * 64;
+			FT_Error error = FT_New_Size(face, &size);
+			if (!error) error = FT_Activate_Size(size);
+			if (!error) error = FT_Set_Pixel_Sizes(face, 0, static_cast<FT_UInt>(std::ceil(pixelSize)));
 			if (error) {
 				std::cerr << "[font] error while setting pixel size: " << error << std::endl;
 			}
@@ -78,30 +478,17 @@ public:
 			emSize = face->units_per_EM;
 		}
 
-		glGenVertexArrays(1, &vao);
-
-		glGenBuffers(1, &vbo);
-		glGenBuffers(1, &ebo);
-
 		glGenTextures(1, &glyphTexture);
 		glGenTextures(1, &curveTexture);
+		glGenTextures(1, &bandTexture);
+		glGenTextures(1, &curveFlagTexture);
 
 		glGenBuffers(1, &glyphBuffer);
 		glGenBuffers(1, &curveBuffer);
-
-		glBindVertexArray(vao);
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 2, GL_FLOAT, false, sizeof(BufferVertex), (void*)offsetof(BufferVertex, x));
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 2, GL_FLOAT, false, sizeof(BufferVertex), (void*)offsetof(BufferVertex, u));
-		glEnableVertexAttribArray(2);
-		glVertexAttribIPointer(2, 1, GL_INT, sizeof(BufferVertex), (void*)offsetof(BufferVertex, bufferIndex));
-		glBindVertexArray(0);
+		glGenBuffers(1, &bandBuffer);
+		glGenBuffers(1, &curveFlagBuffer);
 
 		{
-			uint32_t charcode = 0;
 			FT_UInt glyphIndex = 0;
 			FT_Error error = FT_Load_Glyph(face, glyphIndex, loadFlags);
 			if (error) {
@@ -109,141 +496,589 @@ public:
 				// Continue, because we always want an entry for the undefined glyph in our glyphs map!
 			}
 
-			buildGlyph(charcode, glyphIndex);
+			buildGlyph(glyphIndex);
 		}
 
-		for (uint32_t charcode = 32; charcode < 128; charcode++) {
-			FT_UInt glyphIndex = FT_Get_Char_Index(face, charcode);
-			if (!glyphIndex) continue;
-
-			FT_Error error = FT_Load_Glyph(face, glyphIndex, loadFlags);
-			if (error) {
-				std::cerr << "[font] error while loading glyph for character " << charcode << ": " << error << std::endl;
-				continue;
+		if (options.preloadAscii) {
+			for (uint32_t charcode = 32; charcode < 128; charcode++) {
+				FT_UInt glyphIndex = getGlyphIndex(charcode);
+				if (glyphIndex && !glyphs.find(glyphIndex)) loadGlyph(glyphIndex);
 			}
-
-			buildGlyph(charcode, glyphIndex);
 		}
 
 		uploadBuffers();
 
 		glBindTexture(GL_TEXTURE_BUFFER, glyphTexture);
-		glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32I, glyphBuffer);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32I, glyphBuffer);
 		glBindTexture(GL_TEXTURE_BUFFER, 0);
 
+		GLenum curveTextureFormat = (options.curveFormat == CurveFormat::QUANTIZED) ? GL_RG16 : GL_RG32F;
 		glBindTexture(GL_TEXTURE_BUFFER, curveTexture);
-		glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, curveBuffer);
+		glTexBuffer(GL_TEXTURE_BUFFER, curveTextureFormat, curveBuffer);
 		glBindTexture(GL_TEXTURE_BUFFER, 0);
-	}
 
-	~Font() {
-		glDeleteVertexArrays(1, &vao);
+		glBindTexture(GL_TEXTURE_BUFFER, bandTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R32I, bandBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
 
-		glDeleteBuffers(1, &vbo);
-		glDeleteBuffers(1, &ebo);
+		glBindTexture(GL_TEXTURE_BUFFER, curveFlagTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R8UI, curveFlagBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
 
+	~GlyphStore() {
 		glDeleteTextures(1, &glyphTexture);
 		glDeleteTextures(1, &curveTexture);
+		glDeleteTextures(1, &bandTexture);
+		glDeleteTextures(1, &curveFlagTexture);
 
 		glDeleteBuffers(1, &glyphBuffer);
 		glDeleteBuffers(1, &curveBuffer);
+		glDeleteBuffers(1, &bandBuffer);
+		glDeleteBuffers(1, &curveFlagBuffer);
 
+		if (size) FT_Done_Size(size);
 		FT_Done_Face(face);
 	}
 
-public:
-	void setWorldSize(float worldSize) {
-		if (worldSize == this->worldSize) return;
-		this->worldSize = worldSize;
+	GlyphStore(const GlyphStore&) = delete;
+	GlyphStore& operator=(const GlyphStore&) = delete;
 
-		if (!hinting) return;
+	bool isHinted() const {
+		return hinting;
+	}
 
-		// We have to rebuild our buffers, because the outline coordinates can
-		// change because of hinting.
+	float getPixelSize() const {
+		return pixelSize;
+	}
 
-		emSize = worldSize * 64;
-		FT_Error error = FT_Set_Pixel_Sizes(face, 0, static_cast<FT_UInt>(std::ceil(worldSize)));
-		if (error) {
-			std::cerr << "[font] error while setting pixel size: " << error << std::endl;
+	// With hinting, the glyphs depend on the size. Returns this store if
+	// the pixel size matches or hinting is disabled, and otherwise a store
+	// that shares the face, the character map and the GPOS table with this
+	// one, but has its own size object and glyphs. The store for a new size
+	// starts empty and builds its glyphs when they are needed.
+	//
+	// All Fonts that use this store share the store of each size. Stores of
+	// sizes that no Font uses are kept for the most recently used sizes
+	// (see Options::hintedSizeCacheCapacity), so that switching back to one
+	// of them does not rebuild anything.
+	std::shared_ptr<GlyphStore> getHintedStore(float pixelSize) {
+		if (!hinting || pixelSize == this->pixelSize) return shared_from_this();
+
+		auto it = std::find_if(sizeStores.begin(), sizeStores.end(), [&](const std::shared_ptr<GlyphStore>& sizeStore) {
+			return sizeStore->pixelSize == pixelSize;
+		});
+
+		if (it == sizeStores.end()) {
+			if (!characterMap) characterMap = buildCharacterMap(face);
+
+			// The new store shares the face, but has its own size object.
+			Options sizeOptions = options;
+			sizeOptions.preloadAscii = false;
+			FT_Reference_Face(face);
+			auto sizeStore = std::make_shared<GlyphStore>(face, sizeOptions, pixelSize);
+			sizeStore->characterMap = characterMap;
+			if (!FT_HAS_KERNING(face)) sizeStore->pairAdjustments = getPairAdjustments();
+			sizeStores.insert(sizeStores.begin(), sizeStore);
+		} else {
+			std::rotate(sizeStores.begin(), it, it + 1);
 		}
 
-		bufferGlyphs.clear();
-		bufferCurves.clear();
-
-		for (auto it = glyphs.begin(); it != glyphs.end(); ) {
-			uint32_t charcode = it->first;
-			FT_UInt glyphIndex = it->second.index;
-
-			FT_Error error = FT_Load_Glyph(face, glyphIndex, loadFlags);
-			if (error) {
-				std::cerr << "[font] error while loading glyph for character " << charcode << ": " << error << std::endl;
-				it = glyphs.erase(it);
-				continue;
-			}
-
-			// This call will overwrite the glyph in the glyphs map. However, it
-			// cannot invalidate the iterator because the glyph is already in
-			// the map if we are here.
-			buildGlyph(charcode, glyphIndex);
-			it++;
+		// sizeStores is ordered from the most to the least recently used
+		// size. Stores with a use count of one are only held by the cache.
+		std::shared_ptr<GlyphStore> sizeStore = sizeStores.front();
+		size_t capacity = static_cast<size_t>(std::max(options.hintedSizeCacheCapacity, 1));
+		for (size_t i = sizeStores.size(); i-- > capacity; ) {
+			if (sizeStores[i].use_count() == 1) sizeStores.erase(sizeStores.begin() + i);
 		}
-
-		uploadBuffers();
+		return sizeStore;
 	}
 
 	void prepareGlyphsForText(const std::string& text) {
-		bool changed = false;
-
 		for (const char* textIt = text.c_str(); *textIt != '\0'; ) {
 			uint32_t charcode = decodeCharcode(&textIt);
 
 			if (charcode == '\r' || charcode == '\n') continue;
-			if(glyphs.count(charcode) != 0) continue;
 
-			FT_UInt glyphIndex = FT_Get_Char_Index(face, charcode);
+			FT_UInt glyphIndex = getGlyphIndex(charcode);
 			if (!glyphIndex) continue;
 
-			FT_Error error = FT_Load_Glyph(face, glyphIndex, loadFlags);
-			if (error) {
-				std::cerr << "[font] error while loading glyph for character " << charcode << ": " << error << std::endl;
+			Glyph* glyph = glyphs.find(glyphIndex);
+			if (glyph) {
+				glyph->lastUsed = frame;
 				continue;
 			}
 
-			buildGlyph(charcode, glyphIndex);
-			changed = true;
+			loadGlyph(glyphIndex);
+		}
+
+		flushUploads();
+	}
+
+	// Returns the glyph for the charcode and builds it if necessary. Falls
+	// back to the undefined glyph if the face has no glyph for the
+	// charcode. New glyphs are only uploaded by flushUploads.
+	Glyph& getGlyph(uint32_t charcode) {
+		return getGlyphForIndex(getGlyphIndex(charcode));
+	}
+
+	// Same for a glyph index (see getGlyphIndex).
+	Glyph& getGlyphForIndex(FT_UInt glyphIndex) {
+		Glyph* glyph = glyphs.find(glyphIndex);
+		if (!glyph && loadGlyph(glyphIndex)) {
+			glyph = glyphs.find(glyphIndex);
+		}
+
+		// The undefined glyph is never evicted.
+		if (!glyph) glyph = glyphs.find(0);
+		glyph->lastUsed = frame;
+		return *glyph;
+	}
+
+	// Uploads the glyphs built since the last upload. Only the data of the
+	// new glyphs is uploaded (see uploadBuffer).
+	void flushUploads() {
+		if (uploadPending) uploadBuffers();
+	}
+
+	// Returns the kerning between two resident glyphs (in em units). The
+	// pairs are computed when a glyph is built (see addKerningPairs), so
+	// drawing and measuring text does not query FreeType or the GPOS table.
+	float getKerning(FT_UInt left, FT_UInt right) const {
+		auto it = kerningPairs.find(kerningKey(left, right));
+		return it != kerningPairs.end() ? it->second : 0.0f;
+	}
+
+	// Decodes the first Unicode code point from the null-terminated UTF-8 string *text and advances *text to point at the next code point.
+	// If the encoding is invalid, advances *text by one byte and returns 0.
+	// *text should not be empty, because it will be advanced past the null terminator.
+	static uint32_t decodeCharcode(const char** text) {
+		uint8_t first = static_cast<uint8_t>((*text)[0]);
+
+		// Fast-path for ASCII.
+		if (first < 128) {
+			(*text)++;
+			return static_cast<uint32_t>(first);
+		}
+
+		// This could probably be optimized a bit.
+		uint32_t result;
+		int size;
+		if ((first & 0xE0) == 0xC0) { // 110xxxxx
+			result = first & 0x1F;
+			size = 2;
+		} else if ((first & 0xF0) == 0xE0) { // 1110xxxx
+			result = first & 0x0F;
+			size = 3;
+		} else if ((first & 0xF8) == 0xF0) { // 11110xxx
+			result = first & 0x07;
+			size = 4;
+		} else {
+			// Invalid encoding.
+			(*text)++;
+			return 0;
 		}
 
-		if (changed) {
-			// Reupload the full buffer contents. To make this even more
-			// dynamic, the buffers could be overallocated and only the added
-			// data could be uploaded.
-			uploadBuffers();
+		for (int i = 1; i < size; i++) {
+			uint8_t value = static_cast<uint8_t>((*text)[i]);
+			// Invalid encoding (also catches a null terminator in the middle of a code point).
+			if ((value & 0xC0) != 0x80) { // 10xxxxxx
+				(*text)++;
+				return 0;
+			}
+			result = (result << 6) | (value & 0x3F);
 		}
+
+		(*text) += size;
+		return result;
 	}
 
 private:
+	// Makes the size of this store the active size of the face, which is
+	// used by FreeType to scale glyphs and kerning.
+	void activateSize() {
+		if (size) FT_Activate_Size(size);
+	}
+
+	static uint64_t kerningKey(FT_UInt left, FT_UInt right) {
+		return (static_cast<uint64_t>(left) << 32) | static_cast<uint64_t>(right);
+	}
+
+	// The GPOS table is only read on the first use and is shared by the
+	// stores of all sizes (see getHintedStore).
+	const std::shared_ptr<const PairAdjustmentTable>& getPairAdjustments() {
+		if (!pairAdjustments) pairAdjustments = std::make_shared<const PairAdjustmentTable>(face);
+		return pairAdjustments;
+	}
+
+	// Kerning from the legacy 'kern' table if the font has one, otherwise
+	// from the GPOS table (see PairAdjustmentTable).
+	float computeKerning(FT_UInt left, FT_UInt right) {
+		if (FT_HAS_KERNING(face)) {
+			activateSize();
+			FT_Vector kerning;
+			FT_Error error = FT_Get_Kerning(face, left, right, kerningMode, &kerning);
+			return error ? 0.0f : (float)kerning.x / emSize;
+		}
+
+		int32_t adjustment = getPairAdjustments()->get(left, right);
+		if (adjustment == 0) return 0.0f;
+
+		// Like FT_KERNING_DEFAULT, round to whole pixels with hinting.
+		float kerning = (float)adjustment / (float)face->units_per_EM;
+		if (hinting) kerning = std::round(kerning * pixelSize) / pixelSize;
+		return kerning;
+	}
+
+	// Computes the kerning between the new glyph and each resident glyph in
+	// both orders. Only pairs with kerning are stored in kerningPairs. The
+	// undefined glyph is never kerned (see Font::layout).
+	void addKerningPairs(FT_UInt glyphIndex) {
+		if (glyphIndex == 0) return;
+		if (!FT_HAS_KERNING(face) && getPairAdjustments()->empty()) return;
+
+		auto addPair = [&](FT_UInt left, FT_UInt right) {
+			float kerning = computeKerning(left, right);
+			if (kerning != 0.0f) kerningPairs[kerningKey(left, right)] = kerning;
+		};
+
+		addPair(glyphIndex, glyphIndex);
+		for (const auto& entry : glyphs) {
+			FT_UInt other = entry.first;
+			if (other == 0 || other == glyphIndex) continue;
+			addPair(glyphIndex, other);
+			addPair(other, glyphIndex);
+		}
+	}
+
+	// Looks up the glyph index for the charcode in the snapshot of the
+	// character map, which is taken on the first call. Charcodes that the
+	// face does not cover cost one lookup instead of a FreeType call.
+	FT_UInt getGlyphIndex(uint32_t charcode) {
+		if (!characterMap) characterMap = buildCharacterMap(face);
+
+		const FT_UInt* glyphIndex = characterMap->find(charcode);
+		return glyphIndex ? *glyphIndex : 0;
+	}
+
+	// Reads all mappings of the active charmap of the face.
+	static std::shared_ptr<const DenseMap<FT_UInt>> buildCharacterMap(FT_Face face) {
+		auto characterMap = std::make_shared<DenseMap<FT_UInt>>();
+
+		FT_UInt glyphIndex;
+		FT_ULong charcode = FT_Get_First_Char(face, &glyphIndex);
+		while (glyphIndex != 0) {
+			// Larger values are not Unicode code points, which are the only
+			// charcodes decodeCharcode returns.
+			if (charcode <= 0x10FFFF) {
+				(*characterMap)[static_cast<uint32_t>(charcode)] = glyphIndex;
+			}
+			charcode = FT_Get_Next_Char(face, charcode, &glyphIndex);
+		}
+
+		return characterMap;
+	}
+
+	// Loads the glyph with FreeType and builds it. Returns false for the
+	// undefined glyph, which is always built, or if the glyph cannot be
+	// loaded.
+	bool loadGlyph(FT_UInt glyphIndex) {
+		if (!glyphIndex) return false;
+
+		activateSize();
+		FT_Error error = FT_Load_Glyph(face, glyphIndex, loadFlags);
+		if (error) {
+			std::cerr << "[font] error while loading glyph " << glyphIndex << ": " << error << std::endl;
+			return false;
+		}
+
+		buildGlyph(glyphIndex);
+		uploadPending = true;
+		return true;
+	}
+
 	void uploadBuffers() {
-		glBindBuffer(GL_TEXTURE_BUFFER, glyphBuffer);
-		glBufferData(GL_TEXTURE_BUFFER, sizeof(BufferGlyph) * bufferGlyphs.size(), bufferGlyphs.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		uploadPending = false;
+		uploadBuffer(glyphBuffer, glyphUpload, bufferGlyphs.data(), sizeof(BufferGlyph) * bufferGlyphs.size());
+
+		if (options.curveFormat == CurveFormat::QUANTIZED) {
+			uploadBuffer(curveBuffer, curveUpload, bufferQuantizedCurves.data(), sizeof(BufferQuantizedCurve) * bufferQuantizedCurves.size());
+		} else if (options.curveFormat == CurveFormat::STRIP) {
+			uploadBuffer(curveBuffer, curveUpload, bufferPoints.data(), sizeof(BufferPoint) * bufferPoints.size());
+		} else {
+			uploadBuffer(curveBuffer, curveUpload, bufferCurves.data(), sizeof(BufferCurve) * bufferCurves.size());
+		}
+
+		uploadBuffer(bandBuffer, bandUpload, bufferBands.data(), sizeof(int32_t) * bufferBands.size());
+		uploadBuffer(curveFlagBuffer, curveFlagUpload, bufferCurveFlags.data(), sizeof(uint8_t) * bufferCurveFlags.size());
+	}
+
+	// Uploads data to a buffer that mostly grows at the end. The buffer is
+	// over-allocated with geometric growth, so that in most cases only the
+	// data after state.uploaded and the dirty range (see compact) have to be
+	// uploaded. When the capacity is exceeded, the buffer is reallocated and
+	// the full data is uploaded. Texture buffers refer to the buffer object,
+	// so they do not have to be updated after a reallocation.
+	void uploadBuffer(GLuint buffer, UploadState& state, const void* data, size_t size) {
+		const size_t minCapacity = 4096;
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+
+		if (size > state.capacity) {
+			state.capacity = std::max({ size, 2 * state.capacity, minCapacity });
+			glBufferData(GL_TEXTURE_BUFFER, state.capacity, NULL, GL_DYNAMIC_DRAW);
+			state.uploaded = 0;
+			frameUploads.count++;
+		}
+
+		size_t dirtyEnd = std::min(state.dirtyEnd, std::min(state.uploaded, size));
+		if (state.dirtyBegin < dirtyEnd) {
+			glBufferSubData(GL_TEXTURE_BUFFER, state.dirtyBegin, dirtyEnd - state.dirtyBegin, bytes + state.dirtyBegin);
+			frameUploads.count++;
+			frameUploads.bytes += dirtyEnd - state.dirtyBegin;
+		}
+
+		if (size > state.uploaded) {
+			glBufferSubData(GL_TEXTURE_BUFFER, state.uploaded, size - state.uploaded, bytes + state.uploaded);
+			frameUploads.count++;
+			frameUploads.bytes += size - state.uploaded;
+		}
+
+		state.uploaded = size;
+		state.dirtyBegin = std::numeric_limits<size_t>::max();
+		state.dirtyEnd = 0;
 
-		glBindBuffer(GL_TEXTURE_BUFFER, curveBuffer);
-		glBufferData(GL_TEXTURE_BUFFER, sizeof(BufferCurve) * bufferCurves.size(), bufferCurves.data(), GL_STATIC_DRAW);
 		glBindBuffer(GL_TEXTURE_BUFFER, 0);
 	}
 
-	void buildGlyph(uint32_t charcode, FT_UInt glyphIndex) {
-		BufferGlyph bufferGlyph;
-		bufferGlyph.start = static_cast<int32_t>(bufferCurves.size());
+	// Evicts the least recently used glyphs until the budgets are met again.
+	// To avoid evicting glyphs in every frame, the glyphs are evicted down to
+	// 90% of the budgets. The data of evicted glyphs stays in the buffers
+	// until it is removed by compact.
+	void evictGlyphs() {
+		auto overBudget = [&](double fraction) {
+			int64_t glyphCount = static_cast<int64_t>(glyphs.size());
+			if (options.glyphBudget > 0 && glyphCount > fraction * options.glyphBudget) return true;
+			if (options.curveBudget > 0 && residentCurves > fraction * options.curveBudget) return true;
+			return false;
+		};
+
+		if (!overBudget(1.0)) return;
+
+		// Candidates are all glyphs that were not used in this frame, except
+		// for the undefined glyph, which is always needed.
+		std::vector<std::pair<uint64_t, int32_t>> candidates;
+		for (const auto& entry : glyphs) {
+			const Glyph& glyph = entry.second;
+			if (entry.first == 0 || glyph.lastUsed >= frame) continue;
+			candidates.push_back(std::make_pair(glyph.lastUsed, glyph.bufferIndex));
+		}
+		std::sort(candidates.begin(), candidates.end());
+
+		int64_t evicted = 0;
+		for (const auto& candidate : candidates) {
+			if (!overBudget(0.9)) break;
+
+			GlyphSlot& slot = glyphSlots[candidate.second];
+			slot.live = false;
+			residentCurves -= slot.curveEnd - slot.curveBegin;
+			glyphs.erase(slot.glyphIndex);
+			statistics.evictedGlyphCount++;
+			evicted++;
+		}
+
+		// Drops the kerning pairs of the evicted glyphs, which are added
+		// again if a glyph is built again (see addKerningPairs).
+		if (evicted) {
+			for (auto it = kerningPairs.begin(); it != kerningPairs.end();) {
+				FT_UInt left = static_cast<FT_UInt>(it->first >> 32);
+				FT_UInt right = static_cast<FT_UInt>(it->first);
+				if (glyphs.find(left) && glyphs.find(right)) {
+					++it;
+				} else {
+					it = kerningPairs.erase(it);
+				}
+			}
+		}
+	}
+
+	// Incrementally removes the data of evicted glyphs from the buffers by
+	// moving the data of the remaining glyphs towards the start of the
+	// buffers, at most options.compactionGlyphsPerFrame glyphs per call.
+	// Skipping evicted glyphs is cheap and not limited, so that a pass
+	// finishes even if many glyphs are added and evicted in each frame.
+	//
+	// A compaction pass starts once at least a quarter of the curve buffer
+	// or of bufferGlyphs belongs to evicted glyphs. During a pass, all
+	// slots before compaction.cursor have been processed, and their live
+	// data is now before the write positions. The data of glyphs that are
+	// added during a pass is appended and processed as well. Because all
+	// references within the data of a glyph are relative to its start
+	// indices, moving a glyph only requires updating these indices and the
+	// bufferIndex in the glyphs map.
+	void compact() {
+		if (!compaction.active) {
+			int64_t deadCurves = curveBufferSize() - residentCurves;
+			int64_t deadGlyphs = static_cast<int64_t>(bufferGlyphs.size() - glyphs.size());
+			if (4 * deadCurves < curveBufferSize() && 4 * deadGlyphs < static_cast<int64_t>(bufferGlyphs.size())) return;
+			compaction = Compaction();
+			compaction.active = true;
+		}
+
+		int moved = 0;
+		while (moved < options.compactionGlyphsPerFrame && compaction.cursor < static_cast<int32_t>(glyphSlots.size())) {
+			int32_t from = compaction.cursor++;
+			GlyphSlot slot = glyphSlots[from];
+			if (!slot.live) continue;
+
+			int32_t to = compaction.glyphWrite++;
+			int32_t curveOffset = compaction.curveWrite - slot.curveBegin;
+			int32_t bandOffset = compaction.bandWrite - slot.bandBegin;
+			int32_t polygonOffset = compaction.polygonWrite - slot.polygonBegin;
+
+			compaction.curveWrite += slot.curveEnd - slot.curveBegin;
+			compaction.bandWrite += slot.bandEnd - slot.bandBegin;
+			compaction.polygonWrite += slot.polygonEnd - slot.polygonBegin;
+
+			if (from == to && curveOffset == 0 && bandOffset == 0 && polygonOffset == 0) continue;
+			moved++;
+
+			moveCurves(slot.curveBegin, slot.curveBegin + curveOffset, slot.curveEnd - slot.curveBegin);
+			std::copy(bufferBands.begin() + slot.bandBegin, bufferBands.begin() + slot.bandEnd, bufferBands.begin() + slot.bandBegin + bandOffset);
+			std::copy(polygonVertices.begin() + slot.polygonBegin, polygonVertices.begin() + slot.polygonEnd, polygonVertices.begin() + slot.polygonBegin + polygonOffset);
+			bandUpload.markDirty(sizeof(int32_t) * (slot.bandBegin + bandOffset), sizeof(int32_t) * (slot.bandEnd + bandOffset));
+
+			BufferGlyph bufferGlyph = bufferGlyphs[from];
+			bufferGlyph.start += curveOffset;
+			bufferGlyph.rotatedStart += curveOffset;
+			bufferGlyph.bandStart += bandOffset;
+			bufferGlyphs[to] = bufferGlyph;
+			glyphUpload.markDirty(sizeof(BufferGlyph) * to, sizeof(BufferGlyph) * (to + 1));
+
+			slot.curveBegin += curveOffset;
+			slot.curveEnd += curveOffset;
+			slot.bandBegin += bandOffset;
+			slot.bandEnd += bandOffset;
+			slot.polygonBegin += polygonOffset;
+			slot.polygonEnd += polygonOffset;
+			glyphSlots[to] = slot;
+
+			Glyph& glyph = *glyphs.find(slot.glyphIndex);
+			glyph.bufferIndex = to;
+			glyph.polygonStart += polygonOffset;
+
+			statistics.movedGlyphCount++;
+		}
+
+		if (compaction.cursor == static_cast<int32_t>(glyphSlots.size())) {
+			bufferGlyphs.resize(compaction.glyphWrite);
+			glyphSlots.resize(compaction.glyphWrite);
+			bufferCurveFlags.resize(compaction.curveWrite);
+			if (options.curveFormat == CurveFormat::QUANTIZED) {
+				bufferQuantizedCurves.resize(compaction.curveWrite);
+			} else if (options.curveFormat == CurveFormat::STRIP) {
+				bufferPoints.resize(compaction.curveWrite);
+			} else {
+				bufferCurves.resize(compaction.curveWrite);
+			}
+			bufferBands.resize(compaction.bandWrite);
+			polygonVertices.resize(compaction.polygonWrite);
+			compaction.active = false;
+		}
+	}
+
+	// Moves count entries of the curve buffer (including their flags) to a
+	// lower position and marks them for upload.
+	void moveCurves(int32_t from, int32_t to, int32_t count) {
+		auto move = [&](auto& vector, UploadState* upload) {
+			using T = typename std::remove_reference<decltype(vector)>::type::value_type;
+			std::copy(vector.begin() + from, vector.begin() + from + count, vector.begin() + to);
+			if (upload) upload->markDirty(sizeof(T) * to, sizeof(T) * (to + count));
+		};
+
+		move(bufferCurveFlags, &curveFlagUpload);
+		if (options.curveFormat == CurveFormat::QUANTIZED) {
+			move(bufferQuantizedCurves, &curveUpload);
+		} else if (options.curveFormat == CurveFormat::STRIP) {
+			move(bufferPoints, &curveUpload);
+		} else {
+			move(bufferCurves, &curveUpload);
+		}
+	}
+
+	void buildGlyph(FT_UInt glyphIndex) {
+		std::vector<BufferCurve> curves;
 
 		short start = 0;
 		for (int i = 0; i < face->glyph->outline.n_contours; i++) {
 			// Note: The end indices in face->glyph->outline.contours are inclusive.
-			convertContour(bufferCurves, &face->glyph->outline, start, face->glyph->outline.contours[i], emSize);
+			convertContour(curves, &face->glyph->outline, start, face->glyph->outline.contours[i], emSize);
 			start = face->glyph->outline.contours[i]+1;
 		}
 
-		bufferGlyph.count = static_cast<int32_t>(bufferCurves.size()) - bufferGlyph.start;
+		BufferGlyph bufferGlyph;
+		bufferGlyph.flags = 0;
+		bufferGlyph.padding = 0;
+		computeBoundingBox(bufferGlyph, curves);
+		computeInteriorRectangles(bufferGlyph, curves);
+
+		// The ray along the y-axis gets its own copy of the curves if the
+		// curves have to be prepared differently for each ray.
+		bool separateRotatedCurves = options.splitMonotonic || options.sortCurves;
+		std::vector<BufferCurve> rotatedCurves;
+
+		if (options.splitMonotonic) {
+			rotatedCurves = splitMonotonic(curves, 0);
+			curves = splitMonotonic(curves, 1);
+			bufferGlyph.flags |= GLYPH_FLAG_MONOTONIC;
+		} else if (separateRotatedCurves) {
+			rotatedCurves = curves;
+		}
+
+		if (options.sortCurves) {
+			sortCurves(curves, 0);
+			sortCurves(rotatedCurves, 1);
+			bufferGlyph.flags |= GLYPH_FLAG_SORTED;
+		}
+
+		// References to the curves relative to start or rotatedStart.
+		std::vector<int32_t> references, rotatedReferences;
+
+		GlyphSlot slot;
+		slot.glyphIndex = glyphIndex;
+		slot.live = true;
+		slot.curveBegin = curveBufferSize();
+		slot.bandBegin = static_cast<int32_t>(bufferBands.size());
+
+		bufferGlyph.start = curveBufferSize();
+		bufferGlyph.count = static_cast<int32_t>(curves.size());
+		appendCurves(bufferGlyph, curves, false, references);
+
+		if (separateRotatedCurves) {
+			bufferGlyph.rotatedStart = curveBufferSize();
+			bufferGlyph.rotatedCount = static_cast<int32_t>(rotatedCurves.size());
+			appendCurves(bufferGlyph, rotatedCurves, true, rotatedReferences);
+		} else {
+			bufferGlyph.rotatedStart = bufferGlyph.start;
+			bufferGlyph.rotatedCount = bufferGlyph.count;
+			rotatedCurves = curves;
+			rotatedReferences = references;
+		}
+
+		buildBands(bufferGlyph, curves, references, rotatedCurves, rotatedReferences);
+
+		statistics.glyphCount++;
+		statistics.curveCount += bufferGlyph.count;
+		if (separateRotatedCurves) statistics.curveCount += bufferGlyph.rotatedCount;
+		if (bufferGlyph.count > 0) {
+			statistics.rayCount += 2;
+			statistics.rayCurveCount += bufferGlyph.count + bufferGlyph.rotatedCount;
+		}
+
+		slot.curveEnd = curveBufferSize();
+		slot.bandEnd = static_cast<int32_t>(bufferBands.size());
+		residentCurves += slot.curveEnd - slot.curveBegin;
 
 		int32_t bufferIndex = static_cast<int32_t>(bufferGlyphs.size());
 		bufferGlyphs.push_back(bufferGlyph);
@@ -257,8 +1092,554 @@ private:
 		glyph.bearingX = face->glyph->metrics.horiBearingX;
 		glyph.bearingY = face->glyph->metrics.horiBearingY;
 		glyph.advance = face->glyph->metrics.horiAdvance;
-		glyphs[charcode] = glyph;
-	}
+		glyph.lastUsed = frame;
+
+		glyph.polygonStart = static_cast<int32_t>(polygonVertices.size());
+		glyph.polygonCount = 0;
+		if (options.tightGeometry) {
+			std::vector<glm::vec2> polygon = computeBoundingPolygon(curves);
+			if (!polygon.empty()) {
+				glyph.polygonCount = static_cast<int32_t>(polygon.size());
+				polygonVertices.insert(polygonVertices.end(), polygon.begin(), polygon.end());
+			}
+
+			if (!curves.empty()) {
+				double quadArea = (double)glyph.width * (double)glyph.height / ((double)emSize * (double)emSize);
+				statistics.outlineArea += computeOutlineArea(curves);
+				statistics.quadArea += quadArea;
+				statistics.polygonArea += polygon.empty() ? quadArea : computePolygonArea(polygon);
+			}
+		}
+
+		slot.polygonBegin = glyph.polygonStart;
+		slot.polygonEnd = glyph.polygonStart + glyph.polygonCount;
+		glyphSlots.push_back(slot);
+
+		addKerningPairs(glyphIndex);
+		glyphs[glyphIndex] = glyph;
+	}
+
+	// Computes a convex polygon (in counterclockwise order) that contains
+	// all curves. This is the convex hull of the control points, which is
+	// simplified to at most options.maxPolygonVertices vertices by
+	// repeatedly removing the edge whose removal adds the least area: its
+	// neighboring edges are extended until they meet, so the polygon only
+	// grows. Returns an empty polygon if the hull is degenerate.
+	std::vector<glm::vec2> computeBoundingPolygon(const std::vector<BufferCurve>& curves) const {
+		std::vector<glm::vec2> points;
+		points.reserve(3 * curves.size());
+		for (const BufferCurve& curve : curves) {
+			points.push_back(glm::vec2(curve.x0, curve.y0));
+			points.push_back(glm::vec2(curve.x1, curve.y1));
+			points.push_back(glm::vec2(curve.x2, curve.y2));
+		}
+
+		std::sort(points.begin(), points.end(), [](const glm::vec2& a, const glm::vec2& b) {
+			return (a.x < b.x) || (a.x == b.x && a.y < b.y);
+		});
+		points.erase(std::unique(points.begin(), points.end()), points.end());
+
+		auto cross = [](const glm::vec2& a, const glm::vec2& b) {
+			return a.x * b.y - a.y * b.x;
+		};
+
+		// Monotone chain algorithm, builds the lower and upper hull.
+		std::vector<glm::vec2> hull(2 * points.size());
+		size_t k = 0;
+		for (size_t i = 0; i < points.size(); i++) {
+			while (k >= 2 && cross(hull[k-1] - hull[k-2], points[i] - hull[k-2]) <= 0) k--;
+			hull[k++] = points[i];
+		}
+		for (size_t i = points.size(), lower = k + 1; i-- > 1; ) {
+			while (k >= lower && cross(hull[k-1] - hull[k-2], points[i-1] - hull[k-2]) <= 0) k--;
+			hull[k++] = points[i-1];
+		}
+		hull.resize((k > 0) ? k - 1 : 0);
+
+		if (hull.size() < 3) return {};
+
+		while (static_cast<int>(hull.size()) > std::max(options.maxPolygonVertices, 3)) {
+			size_t n = hull.size();
+			size_t best = n;
+			float bestArea = std::numeric_limits<float>::infinity();
+			glm::vec2 bestPoint;
+
+			for (size_t i = 0; i < n; i++) {
+				// Remove the edge from b to c by extending the edges a-b and
+				// d-c beyond b and c respectively.
+				const glm::vec2& a = hull[(i + n - 1) % n];
+				const glm::vec2& b = hull[i];
+				const glm::vec2& c = hull[(i + 1) % n];
+				const glm::vec2& d = hull[(i + 2) % n];
+
+				glm::vec2 d1 = b - a;
+				glm::vec2 d2 = c - d;
+				float denominator = cross(d1, d2);
+				if (std::abs(denominator) < 1e-12f) continue;
+
+				float s = cross(c - b, d2) / denominator;
+				float r = cross(c - b, d1) / denominator;
+				if (s < 0 || r < 0) continue;
+
+				glm::vec2 q = b + s * d1;
+				float area = 0.5f * std::abs(cross(c - b, q - b));
+				if (area < bestArea) {
+					best = i;
+					bestArea = area;
+					bestPoint = q;
+				}
+			}
+
+			if (best == n) break;
+
+			hull[best] = bestPoint;
+			hull.erase(hull.begin() + (best + 1) % n);
+		}
+
+		return hull;
+	}
+
+	static double computePolygonArea(const std::vector<glm::vec2>& polygon) {
+		double area = 0.0;
+		for (size_t i = 0; i < polygon.size(); i++) {
+			const glm::vec2& a = polygon[i];
+			const glm::vec2& b = polygon[(i + 1) % polygon.size()];
+			area += (double)a.x * b.y - (double)a.y * b.x;
+		}
+		return 0.5 * std::abs(area);
+	}
+
+	// Area enclosed by the curves, assuming that the contours do not
+	// overlap. Each curve contributes the signed area between the curve and
+	// the origin, which is (2 p0×p1 + 2 p1×p2 + p0×p2) / 6 for a quadratic
+	// bezier curve.
+	static double computeOutlineArea(const std::vector<BufferCurve>& curves) {
+		double area = 0.0;
+		for (const BufferCurve& curve : curves) {
+			double c01 = (double)curve.x0 * curve.y1 - (double)curve.y0 * curve.x1;
+			double c12 = (double)curve.x1 * curve.y2 - (double)curve.y1 * curve.x2;
+			double c02 = (double)curve.x0 * curve.y2 - (double)curve.y0 * curve.x2;
+			area += (2.0 * c01 + 2.0 * c12 + c02) / 6.0;
+		}
+		return std::abs(area);
+	}
+
+	// Computes the bounding box of the control points of the glyph, which is
+	// used to map samples to bands. The box is never empty, so that the
+	// shader can divide by its size.
+	void computeBoundingBox(BufferGlyph& bufferGlyph, const std::vector<BufferCurve>& curves) {
+		bufferGlyph.minX = bufferGlyph.minY = +std::numeric_limits<float>::infinity();
+		bufferGlyph.maxX = bufferGlyph.maxY = -std::numeric_limits<float>::infinity();
+
+		for (const BufferCurve& curve : curves) {
+			bufferGlyph.minX = std::min({ bufferGlyph.minX, curve.x0, curve.x1, curve.x2 });
+			bufferGlyph.minY = std::min({ bufferGlyph.minY, curve.y0, curve.y1, curve.y2 });
+			bufferGlyph.maxX = std::max({ bufferGlyph.maxX, curve.x0, curve.x1, curve.x2 });
+			bufferGlyph.maxY = std::max({ bufferGlyph.maxY, curve.y0, curve.y1, curve.y2 });
+		}
+
+		if (curves.empty()) {
+			bufferGlyph.minX = bufferGlyph.minY = 0.0f;
+			bufferGlyph.maxX = bufferGlyph.maxY = 0.0f;
+		}
+
+		const float minSize = 1e-6f;
+		if (bufferGlyph.maxX - bufferGlyph.minX < minSize) bufferGlyph.maxX = bufferGlyph.minX + minSize;
+		if (bufferGlyph.maxY - bufferGlyph.minY < minSize) bufferGlyph.maxY = bufferGlyph.minY + minSize;
+	}
+
+	// Finds up to INTERIOR_RECTANGLE_COUNT disjoint rectangles that are
+	// completely inside the glyph. The bounding box is divided into a grid
+	// and a cell is considered interior if no curve comes close to it and
+	// its center is inside the glyph. The largest rectangles of interior
+	// cells are chosen greedily.
+	//
+	// The rectangles are not shrunk by the anti-aliasing window here, because
+	// its size depends on the pixel size. The shader does this instead.
+	void computeInteriorRectangles(BufferGlyph& bufferGlyph, const std::vector<BufferCurve>& curves) {
+		for (int i = 0; i < INTERIOR_RECTANGLE_COUNT; i++) {
+			bufferGlyph.interior[i] = BufferRectangle{ 1.0f, 1.0f, -1.0f, -1.0f };
+		}
+
+		if (curves.empty()) return;
+
+		float width = bufferGlyph.maxX - bufferGlyph.minX;
+		float height = bufferGlyph.maxY - bufferGlyph.minY;
+		statistics.boundingBoxArea += width * height;
+
+		if (!options.interiorRectangles) return;
+
+		const int n = 32;
+		float cellWidth = width / n;
+		float cellHeight = height / n;
+
+		auto cellX = [&](float x) { return glm::clamp(static_cast<int>(std::floor((x - bufferGlyph.minX) / cellWidth)), 0, n - 1); };
+		auto cellY = [&](float y) { return glm::clamp(static_cast<int>(std::floor((y - bufferGlyph.minY) / cellHeight)), 0, n - 1); };
+
+		// Block all cells overlapping the bounding box of the control points
+		// of a curve, which contains the curve. The margin covers rounding
+		// and quantization errors (see CurveFormat::QUANTIZED).
+		std::vector<bool> interior(n * n, true);
+		float epsilonX = 1e-3f * cellWidth;
+		float epsilonY = 1e-3f * cellHeight;
+		for (const BufferCurve& curve : curves) {
+			int x0 = cellX(std::min({ curve.x0, curve.x1, curve.x2 }) - epsilonX);
+			int x1 = cellX(std::max({ curve.x0, curve.x1, curve.x2 }) + epsilonX);
+			int y0 = cellY(std::min({ curve.y0, curve.y1, curve.y2 }) - epsilonY);
+			int y1 = cellY(std::max({ curve.y0, curve.y1, curve.y2 }) + epsilonY);
+			for (int y = y0; y <= y1; y++) {
+				for (int x = x0; x <= x1; x++) {
+					interior[y * n + x] = false;
+				}
+			}
+		}
+
+		// Neighboring cells that are not blocked are on the same side of all
+		// curves, so it is sufficient to test one cell per run.
+		for (int y = 0; y < n; y++) {
+			bool inside = false;
+			for (int x = 0; x < n; x++) {
+				if (!interior[y * n + x]) continue;
+				if (x == 0 || !interior[y * n + x - 1]) {
+					float centerX = bufferGlyph.minX + (x + 0.5f) * cellWidth;
+					float centerY = bufferGlyph.minY + (y + 0.5f) * cellHeight;
+					inside = computeWindingNumber(curves, centerX, centerY) > 0;
+				}
+				interior[y * n + x] = inside;
+			}
+		}
+
+		for (int i = 0; i < INTERIOR_RECTANGLE_COUNT; i++) {
+			// Largest rectangle of interior cells using a histogram of the
+			// number of interior cells above each cell.
+			int bestArea = 0, bestX0 = 0, bestY0 = 0, bestX1 = 0, bestY1 = 0;
+			std::vector<int> heights(n, 0);
+			for (int y = 0; y < n; y++) {
+				for (int x = 0; x < n; x++) {
+					heights[x] = interior[y * n + x] ? heights[x] + 1 : 0;
+				}
+
+				for (int x = 0; x < n; x++) {
+					int h = heights[x];
+					if (h == 0) continue;
+					int x0 = x, x1 = x;
+					while (x0 > 0 && heights[x0 - 1] >= h) x0--;
+					while (x1 < n - 1 && heights[x1 + 1] >= h) x1++;
+					int area = (x1 - x0 + 1) * h;
+					if (area > bestArea) {
+						bestArea = area;
+						bestX0 = x0;
+						bestY0 = y - h + 1;
+						bestX1 = x1;
+						bestY1 = y;
+					}
+				}
+			}
+
+			if (bestArea == 0) break;
+
+			BufferRectangle& rectangle = bufferGlyph.interior[i];
+			rectangle.minX = bufferGlyph.minX + bestX0 * cellWidth;
+			rectangle.minY = bufferGlyph.minY + bestY0 * cellHeight;
+			rectangle.maxX = bufferGlyph.minX + (bestX1 + 1) * cellWidth;
+			rectangle.maxY = bufferGlyph.minY + (bestY1 + 1) * cellHeight;
+			statistics.interiorArea += (rectangle.maxX - rectangle.minX) * (rectangle.maxY - rectangle.minY);
+
+			for (int y = bestY0; y <= bestY1; y++) {
+				for (int x = bestX0; x <= bestX1; x++) {
+					interior[y * n + x] = false;
+				}
+			}
+		}
+	}
+
+	// Counts the intersections of the ray from (x, y) along the positive
+	// x-axis with the curves like the shader does without anti-aliasing.
+	// Exits count as +1 and entries as -1.
+	static int computeWindingNumber(const std::vector<BufferCurve>& curves, float x, float y) {
+		int winding = 0;
+
+		for (const BufferCurve& curve : curves) {
+			glm::vec2 p0 = glm::vec2(curve.x0 - x, curve.y0 - y);
+			glm::vec2 p1 = glm::vec2(curve.x1 - x, curve.y1 - y);
+			glm::vec2 p2 = glm::vec2(curve.x2 - x, curve.y2 - y);
+
+			if (p0.y > 0 && p1.y > 0 && p2.y > 0) continue;
+			if (p0.y < 0 && p1.y < 0 && p2.y < 0) continue;
+
+			glm::vec2 a = p0 - 2.0f * p1 + p2;
+			glm::vec2 b = p0 - p1;
+			glm::vec2 c = p0;
+
+			float t0, t1;
+			if (std::abs(a.y) >= 1e-5f) {
+				float radicand = b.y * b.y - a.y * c.y;
+				if (radicand <= 0) continue;
+
+				float s = std::sqrt(radicand);
+				t0 = (b.y - s) / a.y;
+				t1 = (b.y + s) / a.y;
+			} else {
+				float t = p0.y / (p0.y - p2.y);
+				t0 = (p0.y < p2.y) ? -1.0f : t;
+				t1 = (p0.y < p2.y) ? t : -1.0f;
+			}
+
+			if (t0 >= 0 && t0 < 1 && (a.x * t0 - 2.0f * b.x) * t0 + c.x > 0) winding++;
+			if (t1 >= 0 && t1 < 1 && (a.x * t1 - 2.0f * b.x) * t1 + c.x > 0) winding--;
+		}
+
+		return winding;
+	}
+
+	// Size of the curve buffer in the units used to reference curves, which
+	// are curves for most formats and texels for CurveFormat::STRIP. The
+	// curve flags are stored in parallel, so they have the same size
+	// regardless of the curve format.
+	int32_t curveBufferSize() const {
+		return static_cast<int32_t>(bufferCurveFlags.size());
+	}
+
+	// Appends the curves to the curve buffer in the configured format
+	// together with their flags and returns a reference to each curve
+	// relative to the start of the appended data. The direction flag refers
+	// to the y-axis after rotation for curves that are used with the ray
+	// along the y-axis (see rotate() in the shader).
+	//
+	// For CurveFormat::STRIP, each run of consecutive curves where the end
+	// point of one curve is the start point of the next curve (usually a
+	// whole contour) is stored as a strip of texels:
+	//   header (number of curves in the strip, 0), p0, p1, p2, p1', p2', ...
+	// A curve is referenced by the texel of its start point, so that it can
+	// still be loaded individually from three consecutive texels, and its
+	// flags are stored at the same index.
+	void appendCurves(const BufferGlyph& bufferGlyph, const std::vector<BufferCurve>& curves, bool rotated, std::vector<int32_t>& references) {
+		int32_t start = curveBufferSize();
+		size_t header = 0;
+
+		references.clear();
+		references.reserve(curves.size());
+
+		for (size_t i = 0; i < curves.size(); i++) {
+			const BufferCurve& curve = curves[i];
+
+			uint8_t flags = 0;
+			bool ascending = rotated ? (curve.x2 < curve.x0) : (curve.y2 > curve.y0);
+			if (ascending) flags |= CURVE_FLAG_ASCENDING;
+
+			if (options.curveFormat == CurveFormat::STRIP) {
+				bool continues = (i > 0 && curves[i-1].x2 == curve.x0 && curves[i-1].y2 == curve.y0);
+				if (continues) {
+					// The start point is the end point of the previous curve.
+					bufferCurveFlags.back() = flags;
+				} else {
+					header = bufferPoints.size();
+					bufferPoints.push_back(BufferPoint{ 0.0f, 0.0f });
+					bufferCurveFlags.push_back(0);
+					bufferPoints.push_back(BufferPoint{ curve.x0, curve.y0 });
+					bufferCurveFlags.push_back(flags);
+				}
+
+				references.push_back(curveBufferSize() - 1 - start);
+
+				bufferPoints.push_back(BufferPoint{ curve.x1, curve.y1 });
+				bufferCurveFlags.push_back(0);
+				bufferPoints.push_back(BufferPoint{ curve.x2, curve.y2 });
+				bufferCurveFlags.push_back(0);
+
+				bufferPoints[header].x += 1.0f;
+				continue;
+			}
+
+			references.push_back(curveBufferSize() - start);
+			bufferCurveFlags.push_back(flags);
+
+			if (options.curveFormat == CurveFormat::QUANTIZED) {
+				bufferQuantizedCurves.push_back(quantizeCurve(bufferGlyph, curve));
+			} else if (options.curveFormat == CurveFormat::COEFFICIENTS) {
+				BufferCurve coefficients = computeCoefficients(curve);
+				float ax = coefficients.x0;
+				float ay = coefficients.y0;
+
+				// Same threshold as in the shader for control points. The ray
+				// along the y-axis uses rotated coordinates, where the
+				// y-coordinate is the negated x-coordinate.
+				if (std::abs(ay) < 1e-5f) bufferCurveFlags.back() |= CURVE_FLAG_LINEAR;
+				if (std::abs(ax) < 1e-5f) bufferCurveFlags.back() |= CURVE_FLAG_ROTATED_LINEAR;
+
+				bufferCurves.push_back(coefficients);
+			} else {
+				bufferCurves.push_back(curve);
+			}
+		}
+	}
+
+	// Returns the coefficients a, b and c of the curve (see
+	// CurveFormat::COEFFICIENTS) stored in place of p0, p1 and p2.
+	static BufferCurve computeCoefficients(const BufferCurve& curve) {
+		BufferCurve result;
+		result.x0 = curve.x0 - 2.0f * curve.x1 + curve.x2;
+		result.y0 = curve.y0 - 2.0f * curve.y1 + curve.y2;
+		result.x1 = curve.x0 - curve.x1;
+		result.y1 = curve.y0 - curve.y1;
+		result.x2 = curve.x0;
+		result.y2 = curve.y0;
+		return result;
+	}
+
+	// Maps the control points to the bounding box of the glyph and rounds
+	// them to 16 bits. The shader reverses the mapping, which results in an
+	// error of at most half a quantization step (relative to the size of the
+	// bounding box) plus rounding errors.
+	BufferQuantizedCurve quantizeCurve(const BufferGlyph& bufferGlyph, const BufferCurve& curve) {
+		const float steps = 65535.0f;
+
+		auto quantize = [&](float value, float lo, float hi) {
+			float normalized = glm::clamp((value - lo) / (hi - lo), 0.0f, 1.0f);
+			uint16_t result = static_cast<uint16_t>(std::round(normalized * steps));
+
+			// Same computation as in the shader.
+			float restored = lo + (hi - lo) * (result / steps);
+			statistics.maxQuantizationError = std::max(statistics.maxQuantizationError, std::abs(restored - value));
+
+			return result;
+		};
+
+		BufferQuantizedCurve result;
+		result.x0 = quantize(curve.x0, bufferGlyph.minX, bufferGlyph.maxX);
+		result.y0 = quantize(curve.y0, bufferGlyph.minY, bufferGlyph.maxY);
+		result.x1 = quantize(curve.x1, bufferGlyph.minX, bufferGlyph.maxX);
+		result.y1 = quantize(curve.y1, bufferGlyph.minY, bufferGlyph.maxY);
+		result.x2 = quantize(curve.x2, bufferGlyph.minX, bufferGlyph.maxX);
+		result.y2 = quantize(curve.y2, bufferGlyph.minY, bufferGlyph.maxY);
+		return result;
+	}
+
+	// Splits each curve at its extremum along the given axis (0 for x, 1 for
+	// y), so that every resulting curve is monotonic along this axis and
+	// intersects a ray perpendicular to it at most once. The shader can then
+	// use a simpler formula with a single root.
+	std::vector<BufferCurve> splitMonotonic(const std::vector<BufferCurve>& curves, int axis) {
+		std::vector<BufferCurve> result;
+		result.reserve(curves.size());
+
+		for (const BufferCurve& curve : curves) {
+			glm::vec2 p0(curve.x0, curve.y0);
+			glm::vec2 p1(curve.x1, curve.y1);
+			glm::vec2 p2(curve.x2, curve.y2);
+
+			// The derivative of the curve along the axis is zero at
+			// t = (p0 - p1) / (p0 - 2*p1 + p2) (see readme).
+			float a = p0[axis] - 2.0f * p1[axis] + p2[axis];
+			float b = p0[axis] - p1[axis];
+			float t = (a != 0.0f) ? b / a : -1.0f;
+
+			if (!(t > 0.0f && t < 1.0f)) {
+				result.push_back(curve);
+				continue;
+			}
+
+			// Split using de Casteljau's algorithm.
+			glm::vec2 q0 = glm::mix(p0, p1, t);
+			glm::vec2 q1 = glm::mix(p1, p2, t);
+			glm::vec2 m = glm::mix(q0, q1, t);
+
+			// The tangent at the extremum is perpendicular to the axis, so
+			// the new control points have the same coordinate as the split
+			// point. Enforce this to keep both halves strictly monotonic
+			// despite rounding errors.
+			q0[axis] = m[axis];
+			q1[axis] = m[axis];
+
+			result.push_back(BufferCurve{ p0.x, p0.y, q0.x, q0.y, m.x, m.y });
+			result.push_back(BufferCurve{ m.x, m.y, q1.x, q1.y, p2.x, p2.y });
+		}
+
+		return result;
+	}
+
+	// Sorts the curves by descending maximum coordinate along the given axis
+	// (0 for x, 1 for y). The rays point in the positive direction, so once
+	// the shader encounters a curve that lies completely behind the sample
+	// (and its anti-aliasing window), all remaining curves do as well and it
+	// can stop iterating. The curves for the ray along the x-axis are sorted
+	// by x, the curves for the ray along the y-axis by y.
+	void sortCurves(std::vector<BufferCurve>& curves, int axis) {
+		auto maxCoordinate = [axis](const BufferCurve& curve) {
+			if (axis == 0) return std::max({ curve.x0, curve.x1, curve.x2 });
+			return std::max({ curve.y0, curve.y1, curve.y2 });
+		};
+
+		std::stable_sort(curves.begin(), curves.end(), [&](const BufferCurve& a, const BufferCurve& b) {
+			return maxCoordinate(a) > maxCoordinate(b);
+		});
+	}
+
+	// Splits the bounding box of the glyph into bandCount horizontal and
+	// bandCount vertical bands of equal size and records which curves overlap
+	// each band. The ray along the x-axis only intersects curves from the
+	// horizontal band containing the sample and the ray along the y-axis only
+	// intersects curves from the vertical band, so the shader can skip all
+	// other curves.
+	//
+	// The data is stored in bufferBands starting at bandStart:
+	// - bandCount headers for the horizontal bands (ordered by y) followed by
+	//   bandCount headers for the vertical bands (ordered by x), each
+	//   consisting of the offset of its curve list relative to bandStart and
+	//   the number of curves in the list,
+	// - the curve lists, which contain references relative to the start of
+	//   the glyph's curves for the respective ray (start or rotatedStart).
+	//   Since the lists preserve the order of the curves, sorted curves stay
+	//   sorted.
+	void buildBands(BufferGlyph& bufferGlyph, const std::vector<BufferCurve>& curves, const std::vector<int32_t>& references, const std::vector<BufferCurve>& rotatedCurves, const std::vector<int32_t>& rotatedReferences) {
+		bufferGlyph.bandStart = static_cast<int32_t>(bufferBands.size());
+		bufferGlyph.bandCount = (bufferGlyph.count > 0) ? options.bandCount : 0;
+
+		int32_t n = bufferGlyph.bandCount;
+		if (n == 0) return;
+
+		bufferBands.resize(bufferBands.size() + 4 * n);
+
+		for (int axis = 0; axis < 2; axis++) {
+			// Horizontal bands (axis 0) divide the glyph along the y-axis,
+			// vertical bands (axis 1) divide it along the x-axis.
+			float lo = (axis == 0) ? bufferGlyph.minY : bufferGlyph.minX;
+			float hi = (axis == 0) ? bufferGlyph.maxY : bufferGlyph.maxX;
+			float size = (hi - lo) / n;
+
+			const std::vector<BufferCurve>& axisCurves = (axis == 0) ? curves : rotatedCurves;
+			const std::vector<int32_t>& axisReferences = (axis == 0) ? references : rotatedReferences;
+
+			// Enlarge the bands slightly, so that samples that are mapped to a
+			// neighboring band due to rounding in the shader are still handled
+			// correctly.
+			float epsilon = 1e-3f * size;
+
+			for (int32_t band = 0; band < n; band++) {
+				float bandMin = lo + band * size - epsilon;
+				float bandMax = lo + (band + 1) * size + epsilon;
+
+				int32_t header = bufferGlyph.bandStart + 2 * (axis * n + band);
+				int32_t offset = static_cast<int32_t>(bufferBands.size()) - bufferGlyph.bandStart;
+
+				for (int32_t i = 0; i < static_cast<int32_t>(axisCurves.size()); i++) {
+					const BufferCurve& curve = axisCurves[i];
+					float c0 = (axis == 0) ? curve.y0 : curve.x0;
+					float c1 = (axis == 0) ? curve.y1 : curve.x1;
+					float c2 = (axis == 0) ? curve.y2 : curve.x2;
+					if (std::max({ c0, c1, c2 }) < bandMin) continue;
+					if (std::min({ c0, c1, c2 }) > bandMax) continue;
+					bufferBands.push_back(axisReferences[i]);
+				}
+
+				bufferBands[header+0] = offset;
+				bufferBands[header+1] = static_cast<int32_t>(bufferBands.size()) - bufferGlyph.bandStart - offset;
+
+				statistics.bandCount++;
+				statistics.bandCurveCount += bufferBands[header+1];
+			}
+		}
+	}
 
 	// This function takes a single contour (defined by firstIndex and
 	// lastIndex, both inclusive) from outline and converts it into individual
@@ -308,15 +1689,16 @@ private:
 		// bezier curves.
 		//
 		// Cubic bezier curves are slightly more difficult, since they have a
-		// higher degree than the shader supports. Each cubic curve is
-		// approximated by two quadratic curves according to the following
-		// paper. This preserves C1-continuity (location of and tangents at
-		// the end points of the cubic curve) and the paper even proves that
-		// splitting at the parametric center minimizes the error due to the
-		// degree reduction. One could also analyze the approximation error
-		// and split the cubic curve, if the error is too large. However,
-		// almost all fonts use "nice" cubic curves, resulting in very small
-		// errors already (see also the section on Font Design in the paper).
+		// higher degree than the shader supports. By default, each cubic
+		// curve is approximated by two quadratic curves according to the
+		// following paper. This preserves C1-continuity (location of and
+		// tangents at the end points of the cubic curve) and the paper even
+		// proves that splitting at the parametric center minimizes the error
+		// due to the degree reduction. Almost all fonts use "nice" cubic
+		// curves, resulting in very small errors already (see also the
+		// section on Font Design in the paper). Alternatively, the number of
+		// quadratic curves can be chosen based on an error bound (see
+		// convertCubic).
 		//
 		// Quadratic Approximation of Cubic Curves
 		// Nghia Truong, Cem Yuksel, Larry Seiler
@@ -325,6 +1707,8 @@ private:
 
 		if (firstIndex == lastIndex) return;
 
+		size_t firstCurve = curves.size();
+
 		short dIndex = 1;
 		if (outline->flags & FT_OUTLINE_REVERSE_FILL) {
 			short tmpIndex = lastIndex;
@@ -384,18 +1768,7 @@ private:
 				control = previous;
 			} else if (currentTag == FT_CURVE_TAG_ON) {
 				if (previousTag == FT_CURVE_TAG_CUBIC) {
-					glm::vec2& b0 = start;
-					glm::vec2& b1 = control;
-					glm::vec2& b2 = previous;
-					glm::vec2& b3 = current;
-
-					glm::vec2 c0 = b0 + 0.75f * (b1 - b0);
-					glm::vec2 c1 = b3 + 0.75f * (b2 - b3);
-
-					glm::vec2 d = makeMidpoint(c0, c1);
-
-					curves.push_back(makeCurve(b0, c0, d));
-					curves.push_back(makeCurve(d, c1, b3));
+					convertCubic(curves, start, control, previous, current);
 				} else if (previousTag == FT_CURVE_TAG_ON) {
 					// Linear segment.
 					curves.push_back(makeCurve(previous, makeMidpoint(previous, current), current));
@@ -422,216 +1795,230 @@ private:
 
 		// Close the contour.
 		if (previousTag == FT_CURVE_TAG_CUBIC) {
-			glm::vec2& b0 = start;
-			glm::vec2& b1 = control;
-			glm::vec2& b2 = previous;
-			glm::vec2& b3 = first;
-
-			glm::vec2 c0 = b0 + 0.75f * (b1 - b0);
-			glm::vec2 c1 = b3 + 0.75f * (b2 - b3);
-
-			glm::vec2 d = makeMidpoint(c0, c1);
-
-			curves.push_back(makeCurve(b0, c0, d));
-			curves.push_back(makeCurve(d, c1, b3));
-
+			convertCubic(curves, start, control, previous, first);
 		} else if (previousTag == FT_CURVE_TAG_ON) {
 			// Linear segment.
 			curves.push_back(makeCurve(previous, makeMidpoint(previous, first), first));
 		} else {
 			curves.push_back(makeCurve(start, previous, first));
 		}
-	}
-
-	// Decodes the first Unicode code point from the null-terminated UTF-8 string *text and advances *text to point at the next code point.
-	// If the encoding is invalid, advances *text by one byte and returns 0.
-	// *text should not be empty, because it will be advanced past the null terminator.
-	uint32_t decodeCharcode(const char** text) {
-		uint8_t first = static_cast<uint8_t>((*text)[0]);
-
-		// Fast-path for ASCII.
-		if (first < 128) {
-			(*text)++;
-			return static_cast<uint32_t>(first);
-		}
-
-		// This could probably be optimized a bit.
-		uint32_t result;
-		int size;
-		if ((first & 0xE0) == 0xC0) { // 110xxxxx
-			result = first & 0x1F;
-			size = 2;
-		} else if ((first & 0xF0) == 0xE0) { // 1110xxxx
-			result = first & 0x0F;
-			size = 3;
-		} else if ((first & 0xF8) == 0xF0) { // 11110xxx
-			result = first & 0x07;
-			size = 4;
-		} else {
-			// Invalid encoding.
-			(*text)++;
-			return 0;
-		}
 
-		for (int i = 1; i < size; i++) {
-			uint8_t value = static_cast<uint8_t>((*text)[i]);
-			// Invalid encoding (also catches a null terminator in the middle of a code point).
-			if ((value & 0xC0) != 0x80) { // 10xxxxxx
-				(*text)++;
-				return 0;
-			}
-			result = (result << 6) | (value & 0x3F);
+		if (options.simplifyCurves) {
+			simplifyContour(curves, firstCurve);
 		}
-
-		(*text) += size;
-		return result;
 	}
 
-public:
-	void drawSetup() {
-		GLint location;
-
-		location = glGetUniformLocation(program, "glyphs");
-		glUniform1i(location, 0);
-		location = glGetUniformLocation(program, "curves");
-		glUniform1i(location, 1);
-
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_BUFFER, glyphTexture);
-
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_BUFFER, curveTexture);
-
-		glActiveTexture(GL_TEXTURE0);
-	}
+	// Simplifies the contour formed by the curves starting at firstCurve:
+	// Curves whose start and end point are identical are removed, because
+	// the intersections of a ray with such a curve always cancel each other
+	// out (this includes zero-length line segments). Consecutive line
+	// segments in the same direction are merged into a single segment.
+	void simplifyContour(std::vector<BufferCurve>& curves, size_t firstCurve) {
+		// Tolerance for collinearity in em units.
+		const float epsilon = 1e-6f;
+
+		auto start = [](const BufferCurve& c) { return glm::vec2(c.x0, c.y0); };
+		auto control = [](const BufferCurve& c) { return glm::vec2(c.x1, c.y1); };
+		auto end = [](const BufferCurve& c) { return glm::vec2(c.x2, c.y2); };
+		auto cross = [](const glm::vec2& a, const glm::vec2& b) { return a.x * b.y - a.y * b.x; };
+
+		// Checks whether b lies on the segment from a to c.
+		auto between = [&](const glm::vec2& a, const glm::vec2& b, const glm::vec2& c) {
+			glm::vec2 ac = c - a;
+			float length = glm::length(ac);
+			return std::abs(cross(b - a, ac)) <= epsilon * length && glm::dot(b - a, c - b) >= 0.0f;
+		};
 
-	void draw(float x, float y, const std::string& text) {
-		float originalX = x;
-		
-		glBindVertexArray(vao);
+		auto isLine = [&](const BufferCurve& c) {
+			return between(start(c), control(c), end(c));
+		};
 
-		std::vector<BufferVertex> vertices;
-		std::vector<int32_t> indices;
+		auto tryMerge = [&](BufferCurve& a, const BufferCurve& b) {
+			if (!isLine(a) || !isLine(b) || !between(start(a), end(a), end(b))) return false;
 
-		FT_UInt previous = 0;
-		for (const char* textIt = text.c_str(); *textIt != '\0'; ) {
-			uint32_t charcode = decodeCharcode(&textIt);
+			glm::vec2 p0 = start(a);
+			glm::vec2 p2 = end(b);
+			glm::vec2 p1 = 0.5f * (p0 + p2);
+			a = BufferCurve{ p0.x, p0.y, p1.x, p1.y, p2.x, p2.y };
+			return true;
+		};
 
-			if (charcode == '\r') continue;
+		size_t count = firstCurve;
+		for (size_t i = firstCurve; i < curves.size(); i++) {
+			const BufferCurve& curve = curves[i];
 
-			if (charcode == '\n') {
-				x = originalX;
-				y -= (float)face->height / (float)face->units_per_EM * worldSize;
-				if (hinting) y = std::round(y);
+			if (curve.x0 == curve.x2 && curve.y0 == curve.y2) {
+				statistics.degenerateCurveCount++;
 				continue;
 			}
 
-			auto glyphIt = glyphs.find(charcode);
-			Glyph& glyph = (glyphIt == glyphs.end()) ? glyphs[0] : glyphIt->second;
-
-			if (previous != 0 && glyph.index != 0) {
-				FT_Vector kerning;
-				FT_Error error = FT_Get_Kerning(face, previous, glyph.index, kerningMode, &kerning);
-				if (!error) {
-					x += (float)kerning.x / emSize * worldSize;
-				}
+			if (count > firstCurve && tryMerge(curves[count-1], curve)) {
+				statistics.mergedCurveCount++;
+				continue;
 			}
 
-			// Do not emit quad for empty glyphs (whitespace).
-			if (glyph.curveCount) {
-				FT_Pos d = (FT_Pos) (emSize * dilation);
+			curves[count++] = curve;
+		}
 
-				float u0 = (float)(glyph.bearingX-d) / emSize;
-				float v0 = (float)(glyph.bearingY-glyph.height-d) / emSize;
-				float u1 = (float)(glyph.bearingX+glyph.width+d) / emSize;
-				float v1 = (float)(glyph.bearingY+d) / emSize;
+		// The contour is closed, so the last segment can be merged into the
+		// first one as well.
+		while (count > firstCurve + 1) {
+			BufferCurve last = curves[count-1];
+			if (!tryMerge(last, curves[firstCurve])) break;
+			curves[firstCurve] = last;
+			count--;
+			statistics.mergedCurveCount++;
+		}
 
-				float x0 = x + u0 * worldSize;
-				float y0 = y + v0 * worldSize;
-				float x1 = x + u1 * worldSize;
-				float y1 = y + v1 * worldSize;
+		curves.resize(count);
+	}
 
-				int32_t base = static_cast<int32_t>(vertices.size());
-				vertices.push_back(BufferVertex{x0, y0, u0, v0, glyph.bufferIndex});
-				vertices.push_back(BufferVertex{x1, y0, u1, v0, glyph.bufferIndex});
-				vertices.push_back(BufferVertex{x1, y1, u1, v1, glyph.bufferIndex});
-				vertices.push_back(BufferVertex{x0, y1, u0, v1, glyph.bufferIndex});
-				indices.insert(indices.end(), { base, base+1, base+2, base+2, base+3, base });
-			}
+	// Approximates the cubic bezier curve b0, b1, b2, b3 by quadratic
+	// curves. Without a tolerance, the curve is split into two quadratic
+	// curves as described in convertContour.
+	//
+	// With a tolerance, the curve is divided into n pieces of equal
+	// parameter length, each of which is approximated by a single quadratic
+	// curve with the control point (3 (b1 + b2) - b0 - b3) / 4. The distance
+	// between such an approximation and the cubic curve is at most
+	// sqrt(3) / 36 * |b3 - 3 b2 + 3 b1 - b0|. A piece of parameter length h
+	// has h^3 times the third difference of the whole curve, wherever it
+	// lies, so splitting recursively would not need fewer pieces than
+	// splitting evenly. n is the smallest number of pieces that meets the
+	// tolerance (often 1), but at most MAX_CUBIC_PIECES, so that a tiny
+	// tolerance cannot blow up the curve buffer. Curves where the cap
+	// applies exceed the tolerance and are counted in
+	// Statistics::clampedCubicCount.
+	void convertCubic(std::vector<BufferCurve>& curves, glm::vec2 b0, glm::vec2 b1, glm::vec2 b2, glm::vec2 b3) {
+		auto push = [&](const glm::vec2& p0, const glm::vec2& p1, const glm::vec2& p2) {
+			curves.push_back(BufferCurve{ p0.x, p0.y, p1.x, p1.y, p2.x, p2.y });
+			statistics.cubicQuadraticCount++;
+		};
 
-			x += (float)glyph.advance / emSize * worldSize;
-			previous = glyph.index;
-		}
+		statistics.cubicCount++;
 
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(BufferVertex) * vertices.size(), vertices.data(), GL_STREAM_DRAW);
+		if (options.cubicTolerance <= 0.0f) {
+			glm::vec2 c0 = b0 + 0.75f * (b1 - b0);
+			glm::vec2 c1 = b3 + 0.75f * (b2 - b3);
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(int32_t) * indices.size(), indices.data(), GL_STREAM_DRAW);
+			glm::vec2 d = 0.5f * (c0 + c1);
 
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+			push(b0, c0, d);
+			push(d, c1, b3);
+			return;
+		}
 
-		glBindVertexArray(0);
+		float error = std::sqrt(3.0f) / 36.0f * glm::length(b3 - 3.0f * b2 + 3.0f * b1 - b0);
+		float pieces = std::ceil(std::cbrt(error / options.cubicTolerance));
+		if (pieces > MAX_CUBIC_PIECES) statistics.clampedCubicCount++;
+		int n = static_cast<int>(glm::clamp(pieces, 1.0f, static_cast<float>(MAX_CUBIC_PIECES)));
+
+		for (int i = 0; i < n; i++) {
+			// Extract the piece between t0 and t1 using the blossom of the
+			// cubic curve, which is exact for both end points.
+			float t0 = static_cast<float>(i) / n;
+			float t1 = static_cast<float>(i + 1) / n;
+
+			auto blossom = [&](float u, float v, float w) {
+				glm::vec2 a0 = glm::mix(b0, b1, u), a1 = glm::mix(b1, b2, u), a2 = glm::mix(b2, b3, u);
+				glm::vec2 c0 = glm::mix(a0, a1, v), c1 = glm::mix(a1, a2, v);
+				return glm::mix(c0, c1, w);
+			};
+
+			glm::vec2 p0 = (i == 0) ? b0 : blossom(t0, t0, t0);
+			glm::vec2 p1 = blossom(t0, t0, t1);
+			glm::vec2 p2 = blossom(t0, t1, t1);
+			glm::vec2 p3 = (i == n - 1) ? b3 : blossom(t1, t1, t1);
+
+			push(p0, 0.25f * (3.0f * (p1 + p2) - p0 - p3), p3);
+		}
 	}
 
-	struct BoundingBox {
-		float minX, minY, maxX, maxY;
-	};
+public:
+	// Should be called once per frame after drawing, also if the store is
+	// shared by several Fonts. Evicts glyphs if the budgets are exceeded,
+	// performs a step of the incremental compaction and uploads the modified
+	// data. Also ends the frame of the stores of the other sizes (see
+	// getHintedStore).
+	void endFrame() {
+		evictGlyphs();
+		compact();
+		uploadBuffers();
 
-	BoundingBox measure(float x, float y, const std::string& text) {
-		BoundingBox bb;
-		bb.minX = +std::numeric_limits<float>::infinity();
-		bb.minY = +std::numeric_limits<float>::infinity();
-		bb.maxX = -std::numeric_limits<float>::infinity();
-		bb.maxY = -std::numeric_limits<float>::infinity();
-
-		float originalX = x;
-		
-		FT_UInt previous = 0;
-		for (const char* textIt = text.c_str(); *textIt != '\0'; ) {
-			uint32_t charcode = decodeCharcode(&textIt);
+		lastFrameUploads = frameUploads;
+		totalUploads.count += frameUploads.count;
+		totalUploads.bytes += frameUploads.bytes;
+		frameUploads = UploadCounters();
 
-			if (charcode == '\r') continue;
+		frame++;
 
-			if (charcode == '\n') {
-				x = originalX;
-				y -= (float)face->height / (float)face->units_per_EM * worldSize;
-				if (hinting) y = std::round(y);
-				continue;
-			}
+		for (const std::shared_ptr<GlyphStore>& sizeStore : sizeStores) sizeStore->endFrame();
+	}
 
-			auto glyphIt = glyphs.find(charcode);
-			Glyph& glyph = (glyphIt == glyphs.end()) ? glyphs[0] : glyphIt->second;
+	const Options& getOptions() const {
+		return options;
+	}
 
-			if (previous != 0 && glyph.index != 0) {
-				FT_Vector kerning;
-				FT_Error error = FT_Get_Kerning(face, previous, glyph.index, kerningMode, &kerning);
-				if (!error) {
-					x += (float)kerning.x / emSize * worldSize;
-				}
-			}
+	const Statistics& getStatistics() const {
+		return statistics;
+	}
 
-			// Note: Do not apply dilation here, we want to calculate exact bounds.
-			float u0 = (float)(glyph.bearingX) / emSize;
-			float v0 = (float)(glyph.bearingY-glyph.height) / emSize;
-			float u1 = (float)(glyph.bearingX+glyph.width) / emSize;
-			float v1 = (float)(glyph.bearingY) / emSize;
-
-			float x0 = x + u0 * worldSize;
-			float y0 = y + v0 * worldSize;
-			float x1 = x + u1 * worldSize;
-			float y1 = y + v1 * worldSize;
-
-			if (x0 < bb.minX) bb.minX = x0;
-			if (y0 < bb.minY) bb.minY = y0;
-			if (x1 > bb.maxX) bb.maxX = x1;
-			if (y1 > bb.maxY) bb.maxY = y1;
-
-			x += (float)glyph.advance / emSize * worldSize;
-			previous = glyph.index;
+	// Computes the current memory usage. This iterates over all glyphs, so
+	// it is meant for telemetry and budgeting, not for every frame.
+	MemoryStatistics getMemoryStatistics() const {
+		MemoryStatistics memory;
+
+		memory.glyphCount = static_cast<int64_t>(glyphs.size());
+		for (const auto& entry : glyphs) {
+			const Glyph& glyph = entry.second;
+			memory.curveCount += glyph.curveCount;
+			if (glyph.curveCount > memory.largestGlyphCurveCount) {
+				memory.largestGlyphIndex = entry.first;
+				memory.largestGlyphCurveCount = glyph.curveCount;
+			}
 		}
 
-		return bb;
+		memory.bufferGlyphCount = static_cast<int64_t>(bufferGlyphs.size());
+		memory.glyphBytes = sizeof(BufferGlyph) * bufferGlyphs.size();
+		memory.curveBytes = sizeof(BufferCurve) * bufferCurves.size()
+			+ sizeof(BufferQuantizedCurve) * bufferQuantizedCurves.size()
+			+ sizeof(BufferPoint) * bufferPoints.size();
+		memory.bandBytes = sizeof(int32_t) * bufferBands.size();
+		memory.curveFlagBytes = sizeof(uint8_t) * bufferCurveFlags.size();
+		memory.polygonBytes = sizeof(glm::vec2) * polygonVertices.size();
+
+		memory.glyphTableSize = static_cast<int64_t>(glyphs.size());
+		memory.glyphTablePageCount = static_cast<int64_t>(glyphs.pageCount());
+		memory.kerningPairCount = static_cast<int64_t>(kerningPairs.size());
+		memory.characterMapSize = characterMap ? static_cast<int64_t>(characterMap->size()) : 0;
+
+		// Each node of the kerning map holds the element and a pointer to
+		// the next node, each bucket a pointer.
+		memory.cpuAllocatedBytes = sizeof(BufferGlyph) * bufferGlyphs.capacity()
+			+ sizeof(BufferCurve) * bufferCurves.capacity()
+			+ sizeof(BufferQuantizedCurve) * bufferQuantizedCurves.capacity()
+			+ sizeof(BufferPoint) * bufferPoints.capacity()
+			+ sizeof(int32_t) * bufferBands.capacity()
+			+ sizeof(uint8_t) * bufferCurveFlags.capacity()
+			+ sizeof(glm::vec2) * polygonVertices.capacity()
+			+ sizeof(GlyphSlot) * glyphSlots.capacity()
+			+ glyphs.allocatedBytes()
+			+ (characterMap ? characterMap->allocatedBytes() : 0)
+			+ (sizeof(std::pair<const uint64_t, float>) + sizeof(void*)) * kerningPairs.size()
+			+ sizeof(void*) * kerningPairs.bucket_count();
+
+		memory.gpuGlyphBytes = glyphUpload.capacity;
+		memory.gpuCurveBytes = curveUpload.capacity;
+		memory.gpuBandBytes = bandUpload.capacity;
+		memory.gpuCurveFlagBytes = curveFlagUpload.capacity;
+		memory.gpuAllocatedBytes = memory.gpuGlyphBytes + memory.gpuCurveBytes + memory.gpuBandBytes + memory.gpuCurveFlagBytes;
+
+		memory.lastFrameUploadCount = lastFrameUploads.count;
+		memory.lastFrameUploadBytes = lastFrameUploads.bytes;
+		memory.totalUploadCount = totalUploads.count + frameUploads.count;
+		memory.totalUploadBytes = totalUploads.bytes + frameUploads.bytes;
+
+		return memory;
 	}
 
 private:
@@ -643,11 +2030,13 @@ private:
 	// If hinting is enabled, we must let FreeType scale the outlines for the hinting to work properly.
 	// The variables loadFlags and kerningMode are set in the constructor and control this scaling behavior.
 	bool hinting;
+	float pixelSize; // size used for hinting (only if hinting is enabled)
+	FT_Size size = NULL;
 	FT_Int32 loadFlags;
 	FT_Kerning_Mode kerningMode;
 
 	// Size of the em square used to convert metrics into em-relative values,
-	// which can then be scaled to the worldSize. We do the scaling ourselves in
+	// which can then be scaled to the worldSize of a Font. We do the scaling ourselves in
 	// floating point to support arbitrary world sizes (whereas the fixed-point
 	// numbers used by FreeType do not have enough resolution if the world size
 	// is small).
@@ -656,21 +2045,1159 @@ private:
 	// If hinting/scaling is not enabled, this value is in font units.
 	float emSize;
 
-	float  worldSize;
+	Options options;
+	Statistics statistics;
 
-	GLuint vao, vbo, ebo;
-	GLuint glyphTexture, curveTexture;
-	GLuint glyphBuffer, curveBuffer;
+	GLuint glyphTexture, curveTexture, bandTexture, curveFlagTexture;
+	GLuint glyphBuffer, curveBuffer, bandBuffer, curveFlagBuffer;
+
+	// Allocated size and size of the data that is already uploaded for each
+	// of the buffers above (see uploadBuffer).
+	UploadState glyphUpload, curveUpload, bandUpload, curveFlagUpload;
 
 	std::vector<BufferGlyph> bufferGlyphs;
-	std::vector<BufferCurve> bufferCurves;
-	std::unordered_map<uint32_t, Glyph> glyphs;
+	std::vector<BufferCurve> bufferCurves;                   // only for CurveFormat::FLOAT and CurveFormat::COEFFICIENTS
+	std::vector<BufferQuantizedCurve> bufferQuantizedCurves; // only for CurveFormat::QUANTIZED
+	std::vector<BufferPoint> bufferPoints;                   // only for CurveFormat::STRIP
+	std::vector<uint8_t> bufferCurveFlags; // one entry per curve reference (see CurveFlags, curveBufferSize)
+	std::vector<int32_t> bufferBands;
+	std::vector<glm::vec2> polygonVertices; // bounding polygons of the glyphs (see computeBoundingPolygon)
+	std::vector<GlyphSlot> glyphSlots;      // parallel to bufferGlyphs
+	DenseMap<Glyph> glyphs; // keyed by glyph index, so charcodes with the same glyph share it
+
+	// Snapshot of the character map of the face (see getGlyphIndex), which
+	// is shared by the stores of all sizes.
+	std::shared_ptr<const DenseMap<FT_UInt>> characterMap;
+
+	// Stores of other pixel sizes (see getHintedStore).
+	std::vector<std::shared_ptr<GlyphStore>> sizeStores;
+
+	// Kerning between pairs of resident glyphs in em units, without the
+	// pairs that have no kerning (see addKerningPairs), and the GPOS
+	// kerning of fonts without a 'kern' table.
+	std::unordered_map<uint64_t, float> kerningPairs;
+	std::shared_ptr<const PairAdjustmentTable> pairAdjustments;
+
+	bool uploadPending = false; // glyphs were built since the last upload
+	uint64_t frame = 0;
+	int64_t residentCurves = 0; // size of the curve data of glyphs that are not evicted
+
+	// Number of uploads and uploaded bytes (see uploadBuffer) in the current
+	// frame, in the last frame and in all frames before the current one.
+	struct UploadCounters {
+		int64_t count = 0;
+		int64_t bytes = 0;
+	};
+	UploadCounters frameUploads, lastFrameUploads, totalUploads;
+
+	// State of the incremental compaction (see compact).
+	struct Compaction {
+		bool active = false;
+		int32_t cursor = 0;
+		int32_t glyphWrite = 0, curveWrite = 0, bandWrite = 0, polygonWrite = 0;
+	};
+	Compaction compaction;
+};
 
+// Ring buffer for vertex data that is written by the CPU once and drawn in
+// the same frame (see Font::draw and TextBatch). The buffer is split into
+// SEGMENT_COUNT segments, which are filled one after another. Data is
+// written with glMapBufferRange without synchronization, so the driver
+// neither allocates new storage nor waits for draw calls that use other
+// parts of the buffer. A fence is inserted when the writing moves on to the
+// next segment, and the CPU only waits for it when it returns to the
+// segment, which is normally SEGMENT_COUNT frames later.
+//
+// If the data of a single write does not fit into a segment, the buffer
+// grows, which allocates new storage for the whole buffer.
+class StreamBuffer {
 public:
-	// ID of the shader program to use.
-	GLuint program = 0;
+	enum { SEGMENT_COUNT = 3 };
 
-	// The glyph quads are expanded by this amount to enable proper
-	// anti-aliasing. Value is relative to emSize.
-	float dilation = 0;
+	// Alignment of the ranges returned by map, which is sufficient for all
+	// vertex attributes and indices.
+	enum { ALIGNMENT = 16 };
+
+	static size_t align(size_t size) {
+		return (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+	}
+
+	// Counters of the data written since the buffer was created and in the
+	// last frame completed by endFrame.
+	struct Statistics {
+		int64_t lastFrameBytes = 0;
+		int64_t lastFrameWriteCount = 0;
+		int64_t lastFrameFenceWaitCount = 0; // fences that were not signaled when a segment was reused
+		int64_t totalBytes = 0;
+		int64_t totalWriteCount = 0;
+		int64_t totalFenceWaitCount = 0;
+		int64_t growCount = 0;
+		int64_t capacity = 0; // size of the buffer in bytes
+	};
+
+	explicit StreamBuffer(size_t segmentSize = 64 * 1024) : segmentSize(segmentSize) {
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, SEGMENT_COUNT * segmentSize, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	~StreamBuffer() {
+		deleteFences();
+		glDeleteBuffers(1, &buffer);
+	}
+
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	GLuint getBuffer() const {
+		return buffer;
+	}
+
+	// Returns a pointer to size bytes of the buffer, which must be written
+	// before the next call to unmap, and their offset in the buffer. The
+	// offset is aligned to ALIGNMENT bytes. Leaves the buffer bound to
+	// GL_ARRAY_BUFFER. size must not be 0, which glMapBufferRange rejects.
+	void* map(size_t size, size_t& offset) {
+		size = align(size);
+
+		if (size > segmentSize) {
+			grow(size);
+		} else if (cursor + size > segmentSize) {
+			nextSegment();
+		}
+
+		// The previous use of the segment must have finished.
+		if (cursor == 0) waitForSegment();
+
+		offset = segment * segmentSize + cursor;
+		cursor += size;
+
+		frameWrites.count++;
+		frameWrites.bytes += size;
+
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		void* data = glMapBufferRange(GL_ARRAY_BUFFER, offset, size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+		// Fall back to an upload with glBufferSubData if mapping fails.
+		mappedOffset = offset;
+		mappedSize = size;
+		mapped = data != NULL;
+		if (!mapped) {
+			fallback.resize(size);
+			data = fallback.data();
+		}
+		return data;
+	}
+
+	void unmap() {
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+		if (mapped) {
+			// Only fails if the data store was lost (e.g. because the display
+			// mode changed), which at most affects the current frame.
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		} else {
+			glBufferSubData(GL_ARRAY_BUFFER, mappedOffset, mappedSize, fallback.data());
+		}
+
+		mapped = false;
+	}
+
+	// Should be called once per frame after drawing, also if the buffer is
+	// shared by several Fonts. Continues with the next segment, so that the
+	// data of a frame is not overwritten before the GPU has finished it.
+	void endFrame() {
+		if (cursor > 0) nextSegment();
+
+		statistics.lastFrameBytes = frameWrites.bytes;
+		statistics.lastFrameWriteCount = frameWrites.count;
+		statistics.lastFrameFenceWaitCount = frameWrites.fenceWaits;
+		statistics.totalBytes += frameWrites.bytes;
+		statistics.totalWriteCount += frameWrites.count;
+		statistics.totalFenceWaitCount += frameWrites.fenceWaits;
+		frameWrites = FrameCounters();
+	}
+
+	Statistics getStatistics() const {
+		Statistics result = statistics;
+		result.capacity = SEGMENT_COUNT * segmentSize;
+		return result;
+	}
+
+private:
+	// Inserts a fence after the commands that use the current segment and
+	// continues with the next one.
+	void nextSegment() {
+		if (fences[segment]) glDeleteSync(fences[segment]);
+		fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		segment = (segment + 1) % SEGMENT_COUNT;
+		cursor = 0;
+	}
+
+	void waitForSegment() {
+		GLsync fence = fences[segment];
+		if (!fence) return;
+
+		GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (result == GL_TIMEOUT_EXPIRED) {
+			frameWrites.fenceWaits++;
+			do {
+				result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			} while (result == GL_TIMEOUT_EXPIRED);
+		}
+
+		glDeleteSync(fence);
+		fences[segment] = 0;
+	}
+
+	// Allocates new storage that is large enough for size bytes per
+	// segment. The old storage is orphaned, so there is nothing to wait for.
+	void grow(size_t size) {
+		while (segmentSize < size) segmentSize *= 2;
+
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, SEGMENT_COUNT * segmentSize, NULL, GL_STREAM_DRAW);
+
+		deleteFences();
+		segment = 0;
+		cursor = 0;
+		statistics.growCount++;
+	}
+
+	void deleteFences() {
+		for (GLsync& fence : fences) {
+			if (fence) glDeleteSync(fence);
+			fence = 0;
+		}
+	}
+
+	GLuint buffer;
+	size_t segmentSize;
+	size_t segment = 0; // segment that is currently written
+	size_t cursor = 0;  // end of the data in the current segment
+	GLsync fences[SEGMENT_COUNT] = {}; // inserted after the last use of each segment
+
+	// Range of the last call to map and CPU-side memory if mapping failed.
+	bool mapped = false;
+	size_t mappedOffset = 0, mappedSize = 0;
+	std::vector<uint8_t> fallback;
+
+	struct FrameCounters {
+		int64_t count = 0;
+		int64_t bytes = 0;
+		int64_t fenceWaits = 0;
+	};
+	FrameCounters frameWrites;
+	Statistics statistics;
+};
+
+// Geometry of a text laid out by a Font, which is kept in its own vertex
+// buffers, so that static text can be drawn every frame without laying it
+// out and uploading it again (see Font::draw(TextBuffer&)). The layout is
+// only computed again if the text or its position changes, if it is drawn
+// with a Font with a different store or world size, or if one of its glyphs
+// was evicted or moved (see GlyphStore::compact).
+//
+// Drawing a TextBuffer marks its glyphs as used like drawing the text
+// directly, so they are not evicted while the buffer is drawn every frame.
+class TextBuffer {
+	friend class Font;
+	friend class TextBatch;
+
+	struct BufferVertex {
+		float   x, y, u, v;
+		int32_t bufferIndex;
+
+		// Direction in which the vertex is moved by the dilation in the
+		// vertex shader (in em units per unit of dilation).
+		float   nx, ny;
+	};
+
+	// Glyph drawn as an instance of a quad, whose corners are computed in the
+	// vertex shader from the bounding box in the glyph buffer. This replaces
+	// four vertices and six indices for glyphs without a bounding polygon.
+	struct BufferInstance {
+		float   x, y; // pen position
+		int32_t bufferIndex;
+		float   scale; // size of one em in model space
+	};
+
+public:
+	TextBuffer() {
+		glGenVertexArrays(1, &vao);
+		glGenVertexArrays(1, &instanceVao);
+
+		glGenBuffers(1, &vbo);
+		glGenBuffers(1, &ebo);
+		glGenBuffers(1, &instanceVbo);
+
+		glBindVertexArray(vao);
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glEnableVertexAttribArray(2);
+		glEnableVertexAttribArray(3);
+
+		glBindVertexArray(instanceVao);
+		glEnableVertexAttribArray(4);
+		glVertexAttribDivisor(4, 1);
+		glEnableVertexAttribArray(5);
+		glVertexAttribDivisor(5, 1);
+		glEnableVertexAttribArray(6);
+		glVertexAttribDivisor(6, 1);
+		glBindVertexArray(0);
+
+		setAttributes(instanceVbo, 0, vbo, 0, ebo);
+	}
+
+	~TextBuffer() {
+		glDeleteVertexArrays(1, &vao);
+
+		glDeleteBuffers(1, &vbo);
+		glDeleteBuffers(1, &ebo);
+
+		glDeleteVertexArrays(1, &instanceVao);
+		glDeleteBuffers(1, &instanceVbo);
+	}
+
+	TextBuffer(const TextBuffer&) = delete;
+	TextBuffer& operator=(const TextBuffer&) = delete;
+
+	// Sets the text and the position of its first baseline. The layout is
+	// computed by the next draw call if anything changed.
+	void setText(float x, float y, const std::string& text) {
+		if (x == this->x && y == this->y && text == this->text) return;
+
+		this->x = x;
+		this->y = y;
+		this->text = text;
+		valid = false;
+	}
+
+	const std::string& getText() const {
+		return text;
+	}
+
+private:
+	void clear() {
+		instances.clear();
+		vertices.clear();
+		indices.clear();
+	}
+
+	// Points the attributes of the vertex arrays to the geometry at the
+	// given offsets (in bytes).
+	void setAttributes(GLuint instanceBuffer, size_t instanceOffset, GLuint vertexBuffer, size_t vertexOffset, GLuint indexBuffer) {
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		glVertexAttribPointer(0, 2, GL_FLOAT, false, sizeof(BufferVertex), (void*)(vertexOffset + offsetof(BufferVertex, x)));
+		glVertexAttribPointer(1, 2, GL_FLOAT, false, sizeof(BufferVertex), (void*)(vertexOffset + offsetof(BufferVertex, u)));
+		glVertexAttribIPointer(2, 1, GL_INT, sizeof(BufferVertex), (void*)(vertexOffset + offsetof(BufferVertex, bufferIndex)));
+		glVertexAttribPointer(3, 2, GL_FLOAT, false, sizeof(BufferVertex), (void*)(vertexOffset + offsetof(BufferVertex, nx)));
+
+		glBindVertexArray(instanceVao);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		glVertexAttribPointer(4, 2, GL_FLOAT, false, sizeof(BufferInstance), (void*)(instanceOffset + offsetof(BufferInstance, x)));
+		glVertexAttribIPointer(5, 1, GL_INT, sizeof(BufferInstance), (void*)(instanceOffset + offsetof(BufferInstance, bufferIndex)));
+		glVertexAttribPointer(6, 1, GL_FLOAT, false, sizeof(BufferInstance), (void*)(instanceOffset + offsetof(BufferInstance, scale)));
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// Uploads the geometry in instances, vertices and indices into the own
+	// buffers of the TextBuffer.
+	void upload() {
+		if (!instances.empty()) {
+			glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(BufferInstance) * instances.size(), instances.data(), GL_STATIC_DRAW);
+		}
+
+		if (!indices.empty()) {
+			glBindBuffer(GL_ARRAY_BUFFER, vbo);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(BufferVertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+
+			// Bound as GL_ARRAY_BUFFER to leave the element array buffer of
+			// the current vertex array unchanged.
+			glBindBuffer(GL_ARRAY_BUFFER, ebo);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(int32_t) * indices.size(), indices.data(), GL_STATIC_DRAW);
+		}
+
+		setAttributes(instanceVbo, 0, vbo, 0, ebo);
+
+		instanceCount = static_cast<GLsizei>(instances.size());
+		indexCount = static_cast<GLsizei>(indices.size());
+		indexOffset = 0;
+	}
+
+	// Writes the geometry into the stream buffer instead, which is only
+	// valid until the end of the frame.
+	void upload(StreamBuffer& stream) {
+		size_t instanceBytes = StreamBuffer::align(sizeof(BufferInstance) * instances.size());
+		size_t vertexBytes = StreamBuffer::align(sizeof(BufferVertex) * vertices.size());
+		size_t indexBytes = sizeof(int32_t) * indices.size();
+
+		instanceCount = static_cast<GLsizei>(instances.size());
+		indexCount = static_cast<GLsizei>(indices.size());
+		if (!instanceCount && !indexCount) return;
+
+		size_t offset;
+		uint8_t* data = static_cast<uint8_t*>(stream.map(instanceBytes + vertexBytes + indexBytes, offset));
+		std::copy(instances.begin(), instances.end(), reinterpret_cast<BufferInstance*>(data));
+		std::copy(vertices.begin(), vertices.end(), reinterpret_cast<BufferVertex*>(data + instanceBytes));
+		std::copy(indices.begin(), indices.end(), reinterpret_cast<int32_t*>(data + instanceBytes + vertexBytes));
+		stream.unmap();
+
+		GLuint buffer = stream.getBuffer();
+		setAttributes(buffer, offset, buffer, offset + instanceBytes, buffer);
+		indexOffset = offset + instanceBytes + vertexBytes;
+	}
+
+	// Glyphs with a bounding polygon (see Options::tightGeometry) are drawn
+	// as indexed triangles and all other glyphs as instanced quads.
+	void draw(GLuint program) const {
+		GLint location = glGetUniformLocation(program, "instanced");
+
+		if (instanceCount) {
+			glBindVertexArray(instanceVao);
+			glUniform1i(location, 1);
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instanceCount);
+		}
+
+		if (indexCount) {
+			glBindVertexArray(vao);
+			glUniform1i(location, 0);
+			glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)indexOffset);
+		}
+
+		glBindVertexArray(0);
+	}
+
+	float x = 0.0f, y = 0.0f;
+	std::string text;
+
+	// State for which the geometry was computed (see Font::draw).
+	bool valid = false;
+	std::weak_ptr<const GlyphStore> store;
+	float worldSize = 0.0f;
+	float dilation = 0.0f;
+
+	// Glyphs referenced by the geometry and their bufferIndex at the time
+	// of the layout, sorted by glyph index and without duplicates.
+	struct GlyphReference {
+		FT_UInt index;
+		int32_t bufferIndex;
+	};
+	std::vector<GlyphReference> glyphs;
+
+	// Geometry of the last layout. The vectors are kept to reuse their
+	// memory.
+	std::vector<BufferInstance> instances;
+	std::vector<BufferVertex> vertices;
+	std::vector<int32_t> indices;
+	GLsizei instanceCount = 0, indexCount = 0;
+	size_t indexOffset = 0; // in bytes
+
+	GLuint vao, vbo, ebo;
+	GLuint instanceVao, instanceVbo;
+};
+
+// Draws text with the glyphs of a GlyphStore at a given size. Fonts are cheap
+// views: the store with the glyph data can be shared by many Fonts, and a
+// Font only allocates vertex buffers when it first draws text that is not
+// in a TextBuffer.
+class Font {
+	friend class TextBatch;
+
+	using Glyph = GlyphStore::Glyph;
+	using BufferVertex = TextBuffer::BufferVertex;
+	using BufferInstance = TextBuffer::BufferInstance;
+
+public:
+	using CurveFormat = GlyphStore::CurveFormat;
+	using Options = GlyphStore::Options;
+	using Statistics = GlyphStore::Statistics;
+	using MemoryStatistics = GlyphStore::MemoryStatistics;
+
+	static FT_Face loadFace(FT_Library library, const std::string& filename, std::string& error) {
+		return GlyphStore::loadFace(library, filename, error);
+	}
+
+	// If hinting is enabled, worldSize must be an integer and defines the font size in pixels used for hinting.
+	// Otherwise, worldSize can be an arbitrary floating-point value.
+	// The Font creates its own GlyphStore, which takes ownership of the face.
+	Font(FT_Face face, float worldSize = 1.0f, bool hinting = false) : Font(face, worldSize, hinting, Options()) {}
+
+	Font(FT_Face face, float worldSize, bool hinting, const Options& options)
+		: Font(std::make_shared<GlyphStore>(face, options, hinting ? worldSize : 0.0f), worldSize) {}
+
+	// Creates a view of a store that may be shared with other Fonts. If the
+	// store uses hinting and has a different pixel size, the store for
+	// worldSize is used instead (see setWorldSize).
+	Font(std::shared_ptr<GlyphStore> store, float worldSize) : baseStore(std::move(store)), worldSize(worldSize) {
+		this->store = baseStore->getHintedStore(worldSize);
+	}
+
+	Font(const Font&) = delete;
+	Font& operator=(const Font&) = delete;
+
+	// With hinting, the glyphs depend on the size, so the Font switches to
+	// the store for the new size, which is shared with the other Fonts of
+	// the store (see GlyphStore::getHintedStore).
+	//
+	// This invalidates the textures and uniforms bound by drawSetup, so call
+	// drawSetup again after changing the size.
+	void setWorldSize(float worldSize) {
+		if (worldSize == this->worldSize) return;
+		this->worldSize = worldSize;
+
+		store = baseStore->getHintedStore(worldSize);
+	}
+
+	void prepareGlyphsForText(const std::string& text) {
+		store->prepareGlyphsForText(text);
+	}
+
+public:
+	void drawSetup() {
+		GLint location;
+
+		location = glGetUniformLocation(program, "glyphs");
+		glUniform1i(location, 0);
+		location = glGetUniformLocation(program, "curves");
+		glUniform1i(location, 1);
+		location = glGetUniformLocation(program, "bands");
+		glUniform1i(location, 2);
+		location = glGetUniformLocation(program, "curveFlags");
+		glUniform1i(location, 3);
+		location = glGetUniformLocation(program, "transforms");
+		glUniform1i(location, 4);
+		location = glGetUniformLocation(program, "curveFormat");
+		glUniform1i(location, static_cast<GLint>(store->options.curveFormat));
+		location = glGetUniformLocation(program, "worldSize");
+		glUniform1f(location, worldSize);
+		location = glGetUniformLocation(program, "quadDilation");
+		glUniform1f(location, dilation);
+
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_BUFFER, store->glyphTexture);
+
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_BUFFER, store->curveTexture);
+
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_BUFFER, store->bandTexture);
+
+		glActiveTexture(GL_TEXTURE3);
+		glBindTexture(GL_TEXTURE_BUFFER, store->curveFlagTexture);
+
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	struct BoundingBox {
+		float minX, minY, maxX, maxY;
+	};
+
+	// Positions of the glyphs of a text (see layout) relative to the start
+	// of its first baseline. A run can be measured and drawn any number of
+	// times without laying out the text again. The glyphs are referenced
+	// by their glyph index, so a run stays valid if glyphs are evicted or
+	// moved, but it depends on the world size of the Font.
+	struct GlyphRun {
+		struct PlacedGlyph {
+			FT_UInt index;
+			float x, y; // pen position
+		};
+
+		struct Line {
+			int32_t glyphBegin, glyphEnd; // range in glyphs
+			float y; // baseline
+			BoundingBox bounds; // empty (min > max) if the line has no glyphs
+		};
+
+		std::vector<PlacedGlyph> glyphs;
+		std::vector<Line> lines;
+
+		// Bounds of the metrics of all glyphs without dilation. Like the
+		// bounds of the lines, they also contain the pen position of glyphs
+		// without width or height, e.g. of spaces.
+		BoundingBox bounds;
+	};
+
+	// Lays out the text into run, reusing its memory, and builds missing
+	// glyphs.
+	void layout(const std::string& text, GlyphRun& run) {
+		run.glyphs.clear();
+		run.lines.clear();
+
+		float lineHeight = (float)store->face->height / (float)store->face->units_per_EM * worldSize;
+		float x = 0.0f, y = 0.0f;
+
+		auto emptyBox = []() {
+			return BoundingBox{
+				+std::numeric_limits<float>::infinity(), +std::numeric_limits<float>::infinity(),
+				-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+			};
+		};
+
+		GlyphRun::Line line = { 0, 0, y, emptyBox() };
+		run.bounds = emptyBox();
+
+		FT_UInt previous = 0;
+		for (const char* textIt = text.c_str(); *textIt != '\0'; ) {
+			uint32_t charcode = GlyphStore::decodeCharcode(&textIt);
+
+			if (charcode == '\r') continue;
+
+			if (charcode == '\n') {
+				line.glyphEnd = static_cast<int32_t>(run.glyphs.size());
+				run.lines.push_back(line);
+
+				x = 0.0f;
+				y -= lineHeight;
+				if (store->hinting) y = std::round(y);
+
+				line = { line.glyphEnd, line.glyphEnd, y, emptyBox() };
+				continue;
+			}
+
+			const Glyph& glyph = store->getGlyph(charcode);
+
+			if (previous != 0 && glyph.index != 0) {
+				x += store->getKerning(previous, glyph.index) * worldSize;
+			}
+
+			run.glyphs.push_back(GlyphRun::PlacedGlyph{ glyph.index, x, y });
+
+			// Note: Do not apply dilation here, we want to calculate exact bounds.
+			float u0 = (float)(glyph.bearingX) / store->emSize;
+			float v0 = (float)(glyph.bearingY-glyph.height) / store->emSize;
+			float u1 = (float)(glyph.bearingX+glyph.width) / store->emSize;
+			float v1 = (float)(glyph.bearingY) / store->emSize;
+
+			BoundingBox& bb = line.bounds;
+			bb.minX = std::min(bb.minX, x + u0 * worldSize);
+			bb.minY = std::min(bb.minY, y + v0 * worldSize);
+			bb.maxX = std::max(bb.maxX, x + u1 * worldSize);
+			bb.maxY = std::max(bb.maxY, y + v1 * worldSize);
+
+			x += (float)glyph.advance / store->emSize * worldSize;
+			previous = glyph.index;
+		}
+
+		line.glyphEnd = static_cast<int32_t>(run.glyphs.size());
+		run.lines.push_back(line);
+
+		for (const GlyphRun::Line& line : run.lines) {
+			run.bounds.minX = std::min(run.bounds.minX, line.bounds.minX);
+			run.bounds.minY = std::min(run.bounds.minY, line.bounds.minY);
+			run.bounds.maxX = std::max(run.bounds.maxX, line.bounds.maxX);
+			run.bounds.maxY = std::max(run.bounds.maxY, line.bounds.maxY);
+		}
+	}
+
+	// Lays out the text in every call. Use a GlyphRun to measure and draw the
+	// same text, and a TextBuffer for text that does not change.
+	void draw(float x, float y, const std::string& text) {
+		layout(text, scratchRun);
+		draw(x, y, scratchRun);
+	}
+
+	// Draws the run with its first baseline starting at (x, y) and writes
+	// its geometry into the stream buffer (see StreamBuffer).
+	void draw(float x, float y, const GlyphRun& run) {
+		if (!streamBuffer) {
+			streamBuffer = std::make_shared<StreamBuffer>();
+			ownsStreamBuffer = true;
+		}
+
+		if (!textBuffer) textBuffer = std::make_unique<TextBuffer>();
+
+		textBuffer->clear();
+		appendGeometry(run, x, y, textBuffer->instances, textBuffer->vertices, textBuffer->indices);
+		textBuffer->upload(*streamBuffer);
+
+		// Upload the glyphs that were built for this text.
+		store->flushUploads();
+
+		textBuffer->draw(program);
+	}
+
+	// Draws the retained geometry of the buffer, which is only laid out and
+	// uploaded again if it is outdated (see TextBuffer).
+	void draw(TextBuffer& buffer) {
+		bool valid = buffer.valid
+			&& buffer.store.lock() == store
+			&& buffer.worldSize == worldSize
+			&& buffer.dilation == dilation
+			&& touchGlyphs(buffer);
+
+		if (!valid) {
+			layout(buffer.text, scratchRun);
+			buffer.clear();
+			appendGeometry(scratchRun, buffer.x, buffer.y, buffer.instances, buffer.vertices, buffer.indices);
+			buffer.upload();
+
+			buffer.glyphs.clear();
+			for (const GlyphRun::PlacedGlyph& placed : scratchRun.glyphs) {
+				const Glyph* glyph = store->glyphs.find(placed.index);
+				if (glyph && glyph->curveCount) buffer.glyphs.push_back(TextBuffer::GlyphReference{ placed.index, glyph->bufferIndex });
+			}
+			std::sort(buffer.glyphs.begin(), buffer.glyphs.end(), [](const TextBuffer::GlyphReference& a, const TextBuffer::GlyphReference& b) {
+				return a.index < b.index;
+			});
+			buffer.glyphs.erase(std::unique(buffer.glyphs.begin(), buffer.glyphs.end(), [](const TextBuffer::GlyphReference& a, const TextBuffer::GlyphReference& b) {
+				return a.index == b.index;
+			}), buffer.glyphs.end());
+
+			buffer.valid = true;
+			buffer.store = store;
+			buffer.worldSize = worldSize;
+			buffer.dilation = dilation;
+		}
+
+		store->flushUploads();
+
+		buffer.draw(program);
+	}
+
+	BoundingBox measure(float x, float y, const std::string& text) {
+		layout(text, scratchRun);
+		const BoundingBox& bounds = scratchRun.bounds;
+		return BoundingBox{ x + bounds.minX, y + bounds.minY, x + bounds.maxX, y + bounds.maxY };
+	}
+
+private:
+	// Marks the glyphs of the buffer as used in the current frame. Returns
+	// false if one of them was evicted or moved since the layout, which
+	// invalidates the geometry of the buffer.
+	bool touchGlyphs(const TextBuffer& buffer) {
+		for (const TextBuffer::GlyphReference& reference : buffer.glyphs) {
+			Glyph* glyph = store->glyphs.find(reference.index);
+			if (!glyph || glyph->bufferIndex != reference.bufferIndex) return false;
+			glyph->lastUsed = store->frame;
+		}
+		return true;
+	}
+
+	// Appends the geometry of the glyphs of the run (see TextBuffer), which
+	// starts at (x, y), and builds glyphs that were evicted. Indices refer
+	// to the whole vertices vector.
+	void appendGeometry(const GlyphRun& run, float x, float y, std::vector<BufferInstance>& instances, std::vector<BufferVertex>& vertices, std::vector<int32_t>& indices) {
+		for (const GlyphRun::PlacedGlyph& placed : run.glyphs) {
+			const Glyph& glyph = store->getGlyphForIndex(placed.index);
+
+			// Do not emit quad for empty glyphs (whitespace).
+			if (glyph.curveCount && glyph.polygonCount) {
+				emitPolygon(vertices, indices, glyph, x + placed.x, y + placed.y);
+			} else if (glyph.curveCount) {
+				instances.push_back(BufferInstance{x + placed.x, y + placed.y, glyph.bufferIndex, worldSize});
+			}
+		}
+	}
+
+	// Emits the bounding polygon of the glyph as a triangle fan. Like the
+	// quad, the polygon is expanded by the dilation (here and in the vertex
+	// shader): each edge is moved outwards, and vertices with a sharp angle
+	// are replaced by two vertices to limit the length of the miter.
+	void emitPolygon(std::vector<BufferVertex>& vertices, std::vector<int32_t>& indices, const Glyph& glyph, float x, float y) {
+		int32_t base = static_cast<int32_t>(vertices.size());
+
+		auto emit = [&](glm::vec2 uv, glm::vec2 normal) {
+			uv += dilation * normal;
+			vertices.push_back(BufferVertex{x + uv.x * worldSize, y + uv.y * worldSize, uv.x, uv.y, glyph.bufferIndex, normal.x, normal.y});
+		};
+
+		const glm::vec2* polygon = &store->polygonVertices[glyph.polygonStart];
+		int32_t n = glyph.polygonCount;
+		for (int32_t i = 0; i < n; i++) {
+			const glm::vec2& previous = polygon[(i + n - 1) % n];
+			const glm::vec2& current = polygon[i];
+			const glm::vec2& next = polygon[(i + 1) % n];
+
+			// Directions and outward normals of the adjacent edges.
+			glm::vec2 e0 = glm::normalize(current - previous);
+			glm::vec2 e1 = glm::normalize(next - current);
+			glm::vec2 n0 = glm::vec2(e0.y, -e0.x);
+			glm::vec2 n1 = glm::vec2(e1.y, -e1.x);
+
+			float cosine = glm::dot(n0, n1);
+			if (cosine >= 0.0f) {
+				emit(current, (n0 + n1) / (1.0f + cosine));
+			} else {
+				emit(current, n0 + e0);
+				emit(current, n1 - e1);
+			}
+		}
+
+		int32_t count = static_cast<int32_t>(vertices.size()) - base;
+		for (int32_t i = 1; i + 1 < count; i++) {
+			indices.insert(indices.end(), { base, base+i, base+i+1 });
+		}
+	}
+
+public:
+	// Only calls GlyphStore::endFrame for the store of the Font (which ends
+	// the stores of all sizes), which must be called once per frame for
+	// each store. If a store is shared by several Fonts, call it on the
+	// shared store directly. StreamBuffer::endFrame is only called for a
+	// stream buffer that the Font created itself; a shared one (see
+	// setStreamBuffer) is ended by its owner.
+	void endFrame() {
+		baseStore->endFrame();
+		if (ownsStreamBuffer) streamBuffer->endFrame();
+	}
+
+	const std::shared_ptr<GlyphStore>& getStore() const {
+		return store;
+	}
+
+	// The stream buffer for the geometry of draw(x, y, text) should be
+	// shared by all Fonts and TextBatches, which then write into the same
+	// ring of segments. A Font without one creates its own when it first
+	// draws such text.
+	void setStreamBuffer(std::shared_ptr<StreamBuffer> streamBuffer) {
+		this->streamBuffer = std::move(streamBuffer);
+		ownsStreamBuffer = false;
+	}
+
+	const std::shared_ptr<StreamBuffer>& getStreamBuffer() const {
+		return streamBuffer;
+	}
+
+	const Options& getOptions() const {
+		return store->getOptions();
+	}
+
+	const Statistics& getStatistics() const {
+		return store->getStatistics();
+	}
+
+	MemoryStatistics getMemoryStatistics() const {
+		return store->getMemoryStatistics();
+	}
+
+private:
+	// The store the Font was created with and the store for the current
+	// size, which differ if the store is hinted (see setWorldSize).
+	std::shared_ptr<GlyphStore> baseStore;
+	std::shared_ptr<GlyphStore> store;
+
+	float  worldSize;
+
+	// Layout of the text of draw(x, y, text), measure and draw(TextBuffer&),
+	// which is replaced in every call.
+	GlyphRun scratchRun;
+
+	// Geometry of the text drawn by draw(x, y, run), which is replaced in
+	// every call and written into streamBuffer. Both are created by the
+	// first call.
+	std::unique_ptr<TextBuffer> textBuffer;
+	std::shared_ptr<StreamBuffer> streamBuffer;
+	bool ownsStreamBuffer = false;
+
+public:
+	// ID of the shader program to use.
+	GLuint program = 0;
+
+	// The glyph quads and polygons are expanded by this amount in addition
+	// to the dilation in the vertex shader, which is computed from the
+	// projected size of a pixel to enable proper anti-aliasing. Value is in
+	// em units (see drawSetup).
+	float dilation = 0;
+};
+
+// Collects the text drawn with any number of Fonts during a frame and draws
+// it with one write into a StreamBuffer and one draw call per Font and kind
+// of geometry (see TextBuffer) in flush. The color and an additional model
+// transform of each text are stored with its glyphs, so texts with different
+// colors and transforms do not need separate draw calls.
+//
+// Texts are drawn grouped by Font in the order in which the Fonts were first
+// used. The uniforms of the programs of the Fonts (projection, view, model,
+// viewportSize, ...) must be set before flush.
+class TextBatch {
+	// Premultiplied color, normalized to 8 bits per channel.
+	struct BatchColor {
+		uint8_t r, g, b, a;
+	};
+
+	// Instance and vertex of TextBuffer with the attributes of their text.
+	struct BatchInstance {
+		TextBuffer::BufferInstance instance;
+		BatchColor color;
+		int32_t    transform; // index in transforms
+	};
+
+	struct BatchVertex {
+		TextBuffer::BufferVertex vertex;
+		BatchColor color;
+		int32_t    transform;
+	};
+
+	struct Submission {
+		Font* font;
+		float x, y;
+		std::string text;
+		BatchColor color;
+		int32_t transform;
+	};
+
+	// Range of the geometry of a Font in the batch buffers.
+	struct Group {
+		Font* font;
+		GLsizei instanceBegin, instanceEnd;
+		GLsizei indexBegin, indexEnd;
+	};
+
+public:
+	// The stream buffer is usually shared with the Fonts (see
+	// Font::setStreamBuffer).
+	explicit TextBatch(std::shared_ptr<StreamBuffer> streamBuffer)
+		: streamBuffer(std::move(streamBuffer)) {
+		glGenVertexArrays(1, &instanceVao);
+		glGenVertexArrays(1, &vao);
+
+		glGenBuffers(1, &transformBuffer);
+		glGenTextures(1, &transformTexture);
+
+		// The attributes are set in flush, because they point to the
+		// geometry in the stream buffer.
+		glBindVertexArray(instanceVao);
+		glEnableVertexAttribArray(4);
+		glVertexAttribDivisor(4, 1);
+		glEnableVertexAttribArray(5);
+		glVertexAttribDivisor(5, 1);
+		glEnableVertexAttribArray(6);
+		glVertexAttribDivisor(6, 1);
+		glEnableVertexAttribArray(7);
+		glVertexAttribDivisor(7, 1);
+		glEnableVertexAttribArray(8);
+		glVertexAttribDivisor(8, 1);
+
+		glBindVertexArray(vao);
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glEnableVertexAttribArray(2);
+		glEnableVertexAttribArray(3);
+		glEnableVertexAttribArray(7);
+		glEnableVertexAttribArray(8);
+		glBindVertexArray(0);
+
+		glBindBuffer(GL_TEXTURE_BUFFER, transformBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, transformTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, transformBuffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	~TextBatch() {
+		glDeleteVertexArrays(1, &instanceVao);
+		glDeleteVertexArrays(1, &vao);
+
+		glDeleteBuffers(1, &transformBuffer);
+		glDeleteTextures(1, &transformTexture);
+	}
+
+	TextBatch(const TextBatch&) = delete;
+	TextBatch& operator=(const TextBatch&) = delete;
+
+	// Adds text that is drawn with the font in the next flush. The color is
+	// premultiplied, and the transform is applied before the model matrix.
+	// The text is laid out in flush with the state of the font at that time.
+	void add(Font& font, float x, float y, const std::string& text, const glm::vec4& color, const glm::mat4& transform = glm::mat4(1.0f)) {
+		if (transforms.empty() || transforms.back() != transform) {
+			transforms.push_back(transform);
+		}
+
+		int32_t transformIndex = static_cast<int32_t>(transforms.size()) - 1;
+		submissions.push_back(Submission{ &font, x, y, text, packColor(color), transformIndex });
+	}
+
+	// Draws and removes all texts added since the last flush.
+	void flush() {
+		if (submissions.empty()) return;
+
+		std::vector<Group> groups;
+		instances.clear();
+		vertices.clear();
+		indices.clear();
+		batchInstances.clear();
+		batchVertices.clear();
+
+		for (size_t first = 0; first < submissions.size(); first++) {
+			Font* font = submissions[first].font;
+			if (std::any_of(groups.begin(), groups.end(), [&](const Group& group) { return group.font == font; })) continue;
+
+			Group group;
+			group.font = font;
+			group.instanceBegin = static_cast<GLsizei>(instances.size());
+			group.indexBegin = static_cast<GLsizei>(indices.size());
+
+			for (size_t i = first; i < submissions.size(); i++) {
+				const Submission& submission = submissions[i];
+				if (submission.font != font) continue;
+
+				size_t instanceBegin = instances.size();
+				size_t vertexBegin = vertices.size();
+				font->layout(submission.text, run);
+				font->appendGeometry(run, submission.x, submission.y, instances, vertices, indices);
+
+				for (size_t j = instanceBegin; j < instances.size(); j++) {
+					batchInstances.push_back(BatchInstance{ instances[j], submission.color, submission.transform });
+				}
+				for (size_t j = vertexBegin; j < vertices.size(); j++) {
+					batchVertices.push_back(BatchVertex{ vertices[j], submission.color, submission.transform });
+				}
+			}
+
+			group.instanceEnd = static_cast<GLsizei>(instances.size());
+			group.indexEnd = static_cast<GLsizei>(indices.size());
+			groups.push_back(group);
+
+			// Upload the glyphs that were built for the texts of this Font.
+			font->store->flushUploads();
+		}
+
+		// Texts of only whitespace have no geometry to draw.
+		if (batchInstances.empty() && indices.empty()) {
+			submissions.clear();
+			transforms.clear();
+			return;
+		}
+
+		upload();
+
+		GLuint currentProgram = 0;
+		for (const Group& group : groups) {
+			Font* font = group.font;
+			if (font->program != currentProgram) {
+				currentProgram = font->program;
+				glUseProgram(currentProgram);
+			}
+
+			font->drawSetup();
+
+			GLint batchedLocation = glGetUniformLocation(currentProgram, "batched");
+			glUniform1i(batchedLocation, 1);
+
+			glActiveTexture(GL_TEXTURE4);
+			glBindTexture(GL_TEXTURE_BUFFER, transformTexture);
+			glActiveTexture(GL_TEXTURE0);
+
+			GLint instancedLocation = glGetUniformLocation(currentProgram, "instanced");
+
+			if (group.instanceEnd > group.instanceBegin) {
+				glBindVertexArray(instanceVao);
+				setInstanceAttributes(group.instanceBegin);
+				glUniform1i(instancedLocation, 1);
+				glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, group.instanceEnd - group.instanceBegin);
+			}
+
+			if (group.indexEnd > group.indexBegin) {
+				glBindVertexArray(vao);
+				glUniform1i(instancedLocation, 0);
+				glDrawElements(GL_TRIANGLES, group.indexEnd - group.indexBegin, GL_UNSIGNED_INT, (void*)(indexOffset + sizeof(int32_t) * group.indexBegin));
+			}
+
+			glBindVertexArray(0);
+			glUniform1i(batchedLocation, 0);
+		}
+
+		submissions.clear();
+		transforms.clear();
+	}
+
+	// Calls StreamBuffer::endFrame (see Font::endFrame).
+	void endFrame() {
+		streamBuffer->endFrame();
+	}
+
+	const std::shared_ptr<StreamBuffer>& getStreamBuffer() const {
+		return streamBuffer;
+	}
+
+private:
+	static BatchColor packColor(const glm::vec4& color) {
+		auto channel = [](float value) {
+			return static_cast<uint8_t>(std::round(glm::clamp(value, 0.0f, 1.0f) * 255.0f));
+		};
+
+		return BatchColor{ channel(color.x), channel(color.y), channel(color.z), channel(color.w) };
+	}
+
+	// Writes the geometry of all groups into the stream buffer and uploads
+	// the transforms. The transforms are read through a buffer texture,
+	// which can only refer to a whole buffer in OpenGL 3.3, so they have a
+	// buffer of their own.
+	void upload() {
+		size_t instanceBytes = StreamBuffer::align(sizeof(BatchInstance) * batchInstances.size());
+		size_t vertexBytes = StreamBuffer::align(sizeof(BatchVertex) * batchVertices.size());
+		size_t indexBytes = sizeof(int32_t) * indices.size();
+
+		size_t offset;
+		uint8_t* data = static_cast<uint8_t*>(streamBuffer->map(instanceBytes + vertexBytes + indexBytes, offset));
+		std::copy(batchInstances.begin(), batchInstances.end(), reinterpret_cast<BatchInstance*>(data));
+		std::copy(batchVertices.begin(), batchVertices.end(), reinterpret_cast<BatchVertex*>(data + instanceBytes));
+		std::copy(indices.begin(), indices.end(), reinterpret_cast<int32_t*>(data + instanceBytes + vertexBytes));
+		streamBuffer->unmap();
+
+		instanceOffset = offset;
+		indexOffset = offset + instanceBytes + vertexBytes;
+
+		size_t vertexOffset = offset + instanceBytes;
+		size_t vertex = vertexOffset + offsetof(BatchVertex, vertex);
+
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, streamBuffer->getBuffer());
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, streamBuffer->getBuffer());
+		glVertexAttribPointer(0, 2, GL_FLOAT, false, sizeof(BatchVertex), (void*)(vertex + offsetof(TextBuffer::BufferVertex, x)));
+		glVertexAttribPointer(1, 2, GL_FLOAT, false, sizeof(BatchVertex), (void*)(vertex + offsetof(TextBuffer::BufferVertex, u)));
+		glVertexAttribIPointer(2, 1, GL_INT, sizeof(BatchVertex), (void*)(vertex + offsetof(TextBuffer::BufferVertex, bufferIndex)));
+		glVertexAttribPointer(3, 2, GL_FLOAT, false, sizeof(BatchVertex), (void*)(vertex + offsetof(TextBuffer::BufferVertex, nx)));
+		glVertexAttribPointer(7, 4, GL_UNSIGNED_BYTE, true, sizeof(BatchVertex), (void*)(vertexOffset + offsetof(BatchVertex, color)));
+		glVertexAttribIPointer(8, 1, GL_INT, sizeof(BatchVertex), (void*)(vertexOffset + offsetof(BatchVertex, transform)));
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		glBindBuffer(GL_TEXTURE_BUFFER, transformBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::mat4) * transforms.size(), transforms.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	// Points the instance attributes to the instances of a group, because
+	// there is no base instance in OpenGL 3.3.
+	void setInstanceAttributes(GLsizei first) {
+		size_t base = instanceOffset + sizeof(BatchInstance) * first;
+		size_t instance = base + offsetof(BatchInstance, instance);
+
+		glBindBuffer(GL_ARRAY_BUFFER, streamBuffer->getBuffer());
+		glVertexAttribPointer(4, 2, GL_FLOAT, false, sizeof(BatchInstance), (void*)(instance + offsetof(TextBuffer::BufferInstance, x)));
+		glVertexAttribIPointer(5, 1, GL_INT, sizeof(BatchInstance), (void*)(instance + offsetof(TextBuffer::BufferInstance, bufferIndex)));
+		glVertexAttribPointer(6, 1, GL_FLOAT, false, sizeof(BatchInstance), (void*)(instance + offsetof(TextBuffer::BufferInstance, scale)));
+		glVertexAttribPointer(7, 4, GL_UNSIGNED_BYTE, true, sizeof(BatchInstance), (void*)(base + offsetof(BatchInstance, color)));
+		glVertexAttribIPointer(8, 1, GL_INT, sizeof(BatchInstance), (void*)(base + offsetof(BatchInstance, transform)));
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	std::vector<Submission> submissions;
+	std::vector<glm::mat4> transforms; // consecutive submissions with the same transform share it
+
+	// Geometry of the current flush, as produced by Font::appendGeometry and
+	// with the attributes of the texts.
+	Font::GlyphRun run;
+	std::vector<TextBuffer::BufferInstance> instances;
+	std::vector<TextBuffer::BufferVertex> vertices;
+	std::vector<int32_t> indices;
+	std::vector<BatchInstance> batchInstances;
+	std::vector<BatchVertex> batchVertices;
+
+	std::shared_ptr<StreamBuffer> streamBuffer;
+	size_t instanceOffset = 0, indexOffset = 0; // of the current flush in the stream buffer (in bytes)
+
+	GLuint instanceVao, vao;
+	GLuint transformBuffer, transformTexture;
 };
@@ -0,0 +1,244 @@
+// Note: See "main.cpp" for headers.
+// This file was extracted to improve the organization of the code,
+// but it is still compiled in the "main.cpp" translation unit,
+// because both files have mostly the same dependencies (OpenGL, GLM, FreeType).
+
+// Horizontal kerning from the pair adjustment lookups (lookup type 2) of the
+// 'kern' feature in the GPOS table of an OpenType font. FT_Get_Kerning only
+// reads the legacy 'kern' table, which many OpenType fonts do not have.
+// The table is kept in its binary form and searched directly, because
+// coverage tables, pair sets and class definitions are sorted by glyph index.
+// All reads are bounds-checked, so a malformed table only results in missing
+// kerning pairs.
+class PairAdjustmentTable {
+public:
+	PairAdjustmentTable() {}
+
+	explicit PairAdjustmentTable(FT_Face face) {
+		FT_ULong length = 0;
+		if (FT_Load_Sfnt_Table(face, TTAG_GPOS, 0, NULL, &length) || length == 0) return;
+
+		table.resize(length);
+		if (FT_Load_Sfnt_Table(face, TTAG_GPOS, 0, table.data(), &length)) {
+			table.clear();
+			return;
+		}
+
+		findLookups();
+	}
+
+	bool empty() const {
+		return lookups.empty();
+	}
+
+	// Returns the adjustment of the advance of the left glyph (in font
+	// units) if it is followed by the right glyph.
+	int32_t get(FT_UInt left, FT_UInt right) const {
+		int32_t adjustment = 0;
+
+		// The first subtable of a lookup that contains the pair applies. The
+		// adjustments of different lookups add up.
+		for (const std::vector<uint32_t>& subtables : lookups) {
+			for (uint32_t subtable : subtables) {
+				uint32_t coverageIndex;
+				if (!findCoverageIndex(subtable + u16(subtable + 2), left, coverageIndex)) continue;
+
+				uint16_t format = u16(subtable);
+				uint16_t valueFormat1 = u16(subtable + 4);
+				uint16_t valueFormat2 = u16(subtable + 6);
+				uint32_t valueSize1 = valueRecordSize(valueFormat1);
+				uint32_t valueSize2 = valueRecordSize(valueFormat2);
+
+				if (format == 1) {
+					// Explicit list of second glyphs for each first glyph.
+					if (coverageIndex >= u16(subtable + 8)) continue;
+					uint32_t pairSet = subtable + u16(subtable + 10 + 2 * coverageIndex);
+					uint32_t recordSize = 2 + valueSize1 + valueSize2;
+
+					uint32_t record;
+					if (!findRecord(pairSet + 2, u16(pairSet), recordSize, right, record)) continue;
+
+					adjustment += xAdvance(valueFormat1, record + 2);
+					break;
+				}
+
+				if (format == 2) {
+					// Adjustments for pairs of glyph classes.
+					uint32_t classDef1 = subtable + u16(subtable + 8);
+					uint32_t classDef2 = subtable + u16(subtable + 10);
+					uint32_t class1Count = u16(subtable + 12);
+					uint32_t class2Count = u16(subtable + 14);
+
+					uint32_t class1 = findClass(classDef1, left);
+					uint32_t class2 = findClass(classDef2, right);
+					if (class1 >= class1Count || class2 >= class2Count) break;
+
+					uint32_t record = subtable + 16 + (class1 * class2Count + class2) * (valueSize1 + valueSize2);
+					adjustment += xAdvance(valueFormat1, record);
+					break;
+				}
+			}
+		}
+
+		return adjustment;
+	}
+
+private:
+	uint16_t u16(uint32_t offset) const {
+		if (static_cast<size_t>(offset) + 2 > table.size()) return 0;
+		return static_cast<uint16_t>((table[offset] << 8) | table[offset + 1]);
+	}
+
+	uint32_t u32(uint32_t offset) const {
+		return (static_cast<uint32_t>(u16(offset)) << 16) | u16(offset + 2);
+	}
+
+	// Collects the pair adjustment subtables of all lookups referenced by a
+	// 'kern' feature. Scripts and languages are not distinguished.
+	void findLookups() {
+		if (u16(0) != 1) return; // major version
+
+		uint32_t featureList = u16(6);
+		uint32_t lookupList = u16(8);
+
+		std::vector<uint16_t> lookupIndices;
+		uint16_t featureCount = u16(featureList);
+		for (uint32_t i = 0; i < featureCount; i++) {
+			uint32_t featureRecord = featureList + 2 + 6 * i;
+			if (u32(featureRecord) != FT_MAKE_TAG('k', 'e', 'r', 'n')) continue;
+
+			uint32_t feature = featureList + u16(featureRecord + 4);
+			uint16_t lookupIndexCount = u16(feature + 2);
+			for (uint32_t j = 0; j < lookupIndexCount; j++) {
+				lookupIndices.push_back(u16(feature + 4 + 2 * j));
+			}
+		}
+
+		// Lookups are applied in the order of the lookup list.
+		std::sort(lookupIndices.begin(), lookupIndices.end());
+		lookupIndices.erase(std::unique(lookupIndices.begin(), lookupIndices.end()), lookupIndices.end());
+
+		uint16_t lookupCount = u16(lookupList);
+		for (uint16_t lookupIndex : lookupIndices) {
+			if (lookupIndex >= lookupCount) continue;
+
+			uint32_t lookup = lookupList + u16(lookupList + 2 + 2 * lookupIndex);
+			uint16_t lookupType = u16(lookup);
+			uint16_t subtableCount = u16(lookup + 4);
+
+			std::vector<uint32_t> subtables;
+			for (uint32_t i = 0; i < subtableCount; i++) {
+				uint32_t subtable = lookup + u16(lookup + 6 + 2 * i);
+				uint16_t type = lookupType;
+
+				// Extension subtables use 32-bit offsets to the actual subtable.
+				if (type == 9 && u16(subtable) == 1) {
+					type = u16(subtable + 2);
+					subtable += u32(subtable + 4);
+				}
+
+				if (type == 2) subtables.push_back(subtable);
+			}
+
+			if (!subtables.empty()) lookups.push_back(subtables);
+		}
+	}
+
+	// Binary search for a record that starts with the glyph index in an
+	// array of records sorted by it.
+	bool findRecord(uint32_t array, uint32_t count, uint32_t recordSize, FT_UInt glyph, uint32_t& record) const {
+		uint32_t low = 0, high = count;
+		while (low < high) {
+			uint32_t middle = (low + high) / 2;
+			uint16_t value = u16(array + middle * recordSize);
+			if (value < glyph) {
+				low = middle + 1;
+			} else if (value > glyph) {
+				high = middle;
+			} else {
+				record = array + middle * recordSize;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Binary search for a range record (start, end, value) containing the
+	// glyph index in an array sorted by the start index.
+	bool findRange(uint32_t array, uint32_t count, FT_UInt glyph, uint32_t& record) const {
+		uint32_t low = 0, high = count;
+		while (low < high) {
+			uint32_t middle = (low + high) / 2;
+			uint32_t range = array + 6 * middle;
+			if (u16(range + 2) < glyph) {
+				low = middle + 1;
+			} else if (u16(range) > glyph) {
+				high = middle;
+			} else {
+				record = range;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool findCoverageIndex(uint32_t coverage, FT_UInt glyph, uint32_t& index) const {
+		uint16_t format = u16(coverage);
+		uint32_t record;
+
+		if (format == 1) {
+			if (!findRecord(coverage + 4, u16(coverage + 2), 2, glyph, record)) return false;
+			index = (record - coverage - 4) / 2;
+			return true;
+		}
+
+		if (format == 2) {
+			if (!findRange(coverage + 4, u16(coverage + 2), glyph, record)) return false;
+			index = u16(record + 4) + (glyph - u16(record));
+			return true;
+		}
+
+		return false;
+	}
+
+	// Returns the class of the glyph, which is zero for glyphs that are not
+	// listed in the class definition.
+	uint32_t findClass(uint32_t classDef, FT_UInt glyph) const {
+		uint16_t format = u16(classDef);
+
+		if (format == 1) {
+			uint16_t startGlyph = u16(classDef + 2);
+			uint16_t glyphCount = u16(classDef + 4);
+			if (glyph < startGlyph || glyph - startGlyph >= glyphCount) return 0;
+			return u16(classDef + 6 + 2 * (glyph - startGlyph));
+		}
+
+		if (format == 2) {
+			uint32_t record;
+			if (!findRange(classDef + 4, u16(classDef + 2), glyph, record)) return 0;
+			return u16(record + 4);
+		}
+
+		return 0;
+	}
+
+	// Each of the lower eight bits of a value format adds a 16-bit field to
+	// a value record.
+	static uint32_t valueRecordSize(uint16_t valueFormat) {
+		uint32_t size = 0;
+		for (int bit = 0; bit < 8; bit++) {
+			if (valueFormat & (1 << bit)) size += 2;
+		}
+		return size;
+	}
+
+	// Reads the XAdvance field, which follows XPlacement and YPlacement if
+	// they are present.
+	int32_t xAdvance(uint16_t valueFormat, uint32_t record) const {
+		if (!(valueFormat & 0x0004)) return 0;
+		return static_cast<int16_t>(u16(record + valueRecordSize(valueFormat & 0x0003)));
+	}
+
+	std::vector<uint8_t> table;
+	std::vector<std::vector<uint32_t>> lookups; // pair adjustment subtables of each lookup
+};
@@ -1,9 +1,14 @@
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <iomanip>
 #include <iostream>
 #include <limits>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
@@ -14,11 +19,15 @@
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include FT_SIZES_H
+#include FT_TRUETYPE_TABLES_H
+#include FT_TRUETYPE_TAGS_H
 
 #include "glm.hpp"
 
 #include "shader_catalog.hpp"
 
+#include "kerning.cpp"
 #include "font.cpp"
 
 struct Transform {
@@ -224,14 +233,42 @@ namespace {
 	std::unique_ptr<Font> mainFont;
 	std::unique_ptr<Font> helpFont;
 
+	// Retained geometry of the main text, which only changes when the main
+	// font is reloaded.
+	std::unique_ptr<TextBuffer> mainTextBuffer;
+
+	// Geometry that is written every frame (the help text), which all fonts
+	// share.
+	std::shared_ptr<StreamBuffer> streamBuffer;
+
+	Font::GlyphRun helpRun;
+
+	// The main font is reloaded with these options when they are changed.
+	std::string mainFontFilename;
+	Font::Options mainFontOptions;
+
 	constexpr float helpFontBaseSize = 20.0f;
 
 	int antiAliasingWindowSize = 1;
 	bool enableSuperSamplingAntiAliasing = true;
 	bool enableControlPointsVisualization = false;
+	bool enableBands = true;
+	bool enableInteriorRectangles = true;
+	bool enableCostVisualization = false;
 
 	bool showHelp = true;
 
+	// Set by the --benchmark command-line option. Prints detailed statistics
+	// and measures the layout whenever the main font is loaded.
+	bool benchmark = false;
+
+	// GPU time spent drawing the main text, measured with a timer query.
+	// A new query is only started after the result of the previous one has
+	// been retrieved to avoid stalling the pipeline.
+	GLuint mainTextQuery;
+	bool mainTextQueryPending = false;
+	double mainTextMilliseconds = 0.0;
+
 	Font::BoundingBox bb;
 	std::string mainText = 
 R"DONE(In the center of Fedora, that gray stone metropolis, stands a metal building
@@ -261,7 +298,7 @@ possible and, a moment later, is possible no longer.
 
 }
 
-static std::unique_ptr<Font> loadFont(const std::string& filename, float worldSize = 1.0f, bool hinting = false) {
+static std::unique_ptr<Font> loadFont(const std::string& filename, float worldSize = 1.0f, bool hinting = false, const Font::Options& options = Font::Options()) {
 	std::string error;
 	FT_Face face = Font::loadFace(library, filename, error);
 	if (error != "") {
@@ -269,18 +306,200 @@ static std::unique_ptr<Font> loadFont(const std::string& filename, float worldSi
 		return std::unique_ptr<Font>{};
 	}
 
-	return std::make_unique<Font>(face, worldSize, hinting);
+	auto font = std::make_unique<Font>(face, worldSize, hinting, options);
+	font->setStreamBuffer(streamBuffer);
+	return font;
+}
+
+static const char* curveFormatName(Font::CurveFormat format) {
+	switch (format) {
+		case Font::CurveFormat::FLOAT:        return "float";
+		case Font::CurveFormat::QUANTIZED:    return "quantized";
+		case Font::CurveFormat::STRIP:        return "strip";
+		case Font::CurveFormat::COEFFICIENTS: return "coefficients";
+	}
+	return "unknown";
+}
+
+// Draws a fixed scene, the main text filling the framebuffer with the
+// current anti-aliasing settings, and returns the average GPU time of a
+// frame in milliseconds. The first frame builds and uploads the glyphs and
+// is not timed. The result of each frame is awaited, so the frames do not
+// overlap.
+static double timeMainText(Font& font, bool bands) {
+	const int frames = 20;
+
+	int width, height;
+	glfwGetFramebufferSize(glfwGetCurrentContext(), &width, &height);
+	glViewport(0, 0, width, height);
+
+	Font::BoundingBox bounds = font.measure(0, 0, mainText);
+	float cx = 0.5f * (bounds.minX + bounds.maxX);
+	float cy = 0.5f * (bounds.minY + bounds.maxY);
+	float aspect = (float)width / height;
+	float halfHeight = 0.5f * std::max(bounds.maxY - bounds.minY, (bounds.maxX - bounds.minX) / aspect);
+
+	TextBuffer buffer;
+	buffer.setText(-cx, -cy, mainText);
+
+	glm::mat4 projection = glm::ortho(-halfHeight * aspect, halfHeight * aspect, -halfHeight, halfHeight, -1.0f, 1.0f);
+	glm::mat4 identity = glm::mat4(1.0f);
+
+	GLuint program = fontShader->program;
+	glUseProgram(program);
+
+	font.program = program;
+	font.drawSetup();
+
+	GLuint location;
+	location = glGetUniformLocation(program, "projection");
+	glUniformMatrix4fv(location, 1, false, glm::value_ptr(projection));
+	location = glGetUniformLocation(program, "view");
+	glUniformMatrix4fv(location, 1, false, glm::value_ptr(identity));
+	location = glGetUniformLocation(program, "model");
+	glUniformMatrix4fv(location, 1, false, glm::value_ptr(identity));
+	location = glGetUniformLocation(program, "viewportSize");
+	glUniform2f(location, (float) width, (float) height);
+
+	location = glGetUniformLocation(program, "color");
+	glUniform4f(location, 1.0f, 1.0f, 1.0f, 1.0f);
+
+	location = glGetUniformLocation(program, "antiAliasingWindowSize");
+	glUniform1f(location, (float) antiAliasingWindowSize);
+	location = glGetUniformLocation(program, "enableSuperSamplingAntiAliasing");
+	glUniform1i(location, enableSuperSamplingAntiAliasing);
+	location = glGetUniformLocation(program, "enableControlPointsVisualization");
+	glUniform1i(location, false);
+	location = glGetUniformLocation(program, "enableBands");
+	glUniform1i(location, bands);
+	location = glGetUniformLocation(program, "enableInteriorRectangles");
+	glUniform1i(location, enableInteriorRectangles);
+	location = glGetUniformLocation(program, "enableCostVisualization");
+	glUniform1i(location, false);
+
+	glEnable(GL_BLEND);
+	glBlendEquation(GL_FUNC_ADD);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+	GLuint query;
+	glGenQueries(1, &query);
+
+	GLuint64 totalNanoseconds = 0;
+	for (int frame = -1; frame < frames; frame++) {
+		glClear(GL_COLOR_BUFFER_BIT);
+
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		font.draw(buffer);
+		glEndQuery(GL_TIME_ELAPSED);
+
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+		if (frame >= 0) totalNanoseconds += nanoseconds;
+
+		font.endFrame();
+	}
+
+	glDeleteQueries(1, &query);
+	glDisable(GL_BLEND);
+	glUseProgram(0);
+
+	return totalNanoseconds / 1e6 / frames;
+}
+
+// Prints the statistics of the glyphs built for the main text, the GPU time
+// of the main text with and without bands and with each curve format (for
+// which the font is loaded again), and compares the layout of the main
+// text and the glyph lookup it is dominated by with a lookup in
+// std::unordered_map.
+static void benchmarkFont(Font& font, const std::string& filename) {
+	const Font::Statistics& statistics = font.getStatistics();
+	double curvesPerRay = (double)statistics.rayCurveCount / (double)std::max<int64_t>(statistics.rayCount, 1);
+	double curvesPerBand = (double)statistics.bandCurveCount / (double)std::max<int64_t>(statistics.bandCount, 1);
+	std::cout << "[benchmark] average curves per ray: " << curvesPerRay << " without bands, " << curvesPerBand << " with bands" << std::endl;
+	std::cout << "[benchmark] simplification removed " << statistics.degenerateCurveCount << " degenerate curves and merged " << statistics.mergedCurveCount << " collinear line segments" << std::endl;
+	if (statistics.cubicCount > 0) {
+		std::cout << "[benchmark] " << statistics.cubicCount << " cubic curves converted to " << statistics.cubicQuadraticCount << " quadratic curves (tolerance: " << mainFontOptions.cubicTolerance << " em, exceeded by " << statistics.clampedCubicCount << ")" << std::endl;
+	}
+	if (mainFontOptions.tightGeometry) {
+		double quadCoverage = statistics.outlineArea / std::max(statistics.quadArea, 1e-12);
+		double polygonCoverage = statistics.outlineArea / std::max(statistics.polygonArea, 1e-12);
+		std::cout << "[benchmark] covered / rasterized area: " << quadCoverage << " with quads, " << polygonCoverage << " with polygons (without dilation)" << std::endl;
+	}
+	double interiorPercentage = 100.0 * statistics.interiorArea / std::max(statistics.boundingBoxArea, 1e-12);
+	std::cout << "[benchmark] interior rectangles cover " << interiorPercentage << "% of the glyph bounding boxes" << std::endl;
+	if (mainFontOptions.curveFormat == Font::CurveFormat::QUANTIZED) {
+		std::cout << "[benchmark] worst-case quantization error: " << statistics.maxQuantizationError << " em" << std::endl;
+	}
+	Font::MemoryStatistics memory = font.getMemoryStatistics();
+	std::cout << "[benchmark] memory: " << memory.cpuAllocatedBytes << " bytes on the CPU, " << memory.gpuAllocatedBytes << " bytes on the GPU, largest glyph: " << memory.largestGlyphCurveCount << " curves (glyph " << memory.largestGlyphIndex << ")" << std::endl;
+
+	double bandsMilliseconds = timeMainText(font, true);
+	double noBandsMilliseconds = timeMainText(font, false);
+	std::cout << "[benchmark] main text GPU time: " << bandsMilliseconds << " ms with bands, " << noBandsMilliseconds << " ms without bands" << std::endl;
+
+	for (Font::CurveFormat format : { Font::CurveFormat::FLOAT, Font::CurveFormat::QUANTIZED, Font::CurveFormat::STRIP, Font::CurveFormat::COEFFICIENTS }) {
+		Font::Options options = mainFontOptions;
+		options.curveFormat = format;
+		auto formatFont = loadFont(filename, 0.05f, false, options);
+		if (!formatFont) return;
+
+		formatFont->prepareGlyphsForText(mainText);
+		double formatBandsMilliseconds = timeMainText(*formatFont, true);
+		double formatNoBandsMilliseconds = timeMainText(*formatFont, false);
+		std::cout << "[benchmark] " << curveFormatName(format) << " curves (" << formatFont->getMemoryStatistics().curveBytes << " bytes): " << formatBandsMilliseconds << " ms with bands, " << formatNoBandsMilliseconds << " ms without bands" << std::endl;
+	}
+
+	const int repetitions = 100;
+
+	// Layout throughput, measured on the prepared glyphs.
+	auto layoutStart = std::chrono::steady_clock::now();
+	for (int i = 0; i < repetitions; i++) font.measure(0, 0, mainText);
+	std::chrono::duration<double, std::nano> layoutTime = std::chrono::steady_clock::now() - layoutStart;
+
+	// The same lookups as in the layout loop, with the code points of the
+	// main text as keys.
+	std::vector<uint32_t> charcodes;
+	for (const char* text = mainText.c_str(); *text;) {
+		charcodes.push_back(GlyphStore::decodeCharcode(&text));
+	}
+	DenseMap<uint32_t> denseMap;
+	std::unordered_map<uint32_t, uint32_t> hashMap;
+	for (uint32_t charcode : charcodes) {
+		denseMap[charcode] = charcode;
+		hashMap[charcode] = charcode;
+	}
+
+	uint32_t checksum = 0;
+	auto denseMapStart = std::chrono::steady_clock::now();
+	for (int i = 0; i < repetitions; i++) {
+		for (uint32_t charcode : charcodes) checksum += *denseMap.find(charcode);
+	}
+	std::chrono::duration<double, std::nano> denseMapTime = std::chrono::steady_clock::now() - denseMapStart;
+	auto hashMapStart = std::chrono::steady_clock::now();
+	for (int i = 0; i < repetitions; i++) {
+		for (uint32_t charcode : charcodes) checksum -= hashMap.find(charcode)->second;
+	}
+	std::chrono::duration<double, std::nano> hashMapTime = std::chrono::steady_clock::now() - hashMapStart;
+
+	double lookups = (double)repetitions * std::max<size_t>(charcodes.size(), 1);
+	std::cout << "[benchmark] layout: " << layoutTime.count() / lookups << " ns per character, glyph lookup: " << denseMapTime.count() / lookups << " ns with DenseMap, " << hashMapTime.count() / lookups << " ns with std::unordered_map" << (checksum ? " (mismatch)" : "") << std::endl;
 }
 
 static void tryUpdateMainFont(const std::string& filename) {
-	auto font = loadFont(filename, 0.05f);
+	auto font = loadFont(filename, 0.05f, false, mainFontOptions);
 	if (!font) return;
 
-	font->dilation = 0.1f;
-
+	auto buildStart = std::chrono::steady_clock::now();
 	font->prepareGlyphsForText(mainText);
+	std::chrono::duration<double, std::milli> buildTime = std::chrono::steady_clock::now() - buildStart;
+
+	const Font::Statistics& statistics = font->getStatistics();
+	Font::MemoryStatistics memory = font->getMemoryStatistics();
+	std::cout << "[font] " << filename << ": " << statistics.glyphCount << " glyphs, " << statistics.curveCount << " curves, " << memory.curveBytes << " bytes of curve data (" << curveFormatName(mainFontOptions.curveFormat) << "), built in " << buildTime.count() << " ms" << std::endl;
+	if (benchmark) benchmarkFont(*font, filename);
 
 	mainFont = std::move(font);
+	mainFontFilename = filename;
 	bb = mainFont->measure(0, 0, mainText);
 }
 
@@ -311,6 +530,56 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
 			enableSuperSamplingAntiAliasing = !enableSuperSamplingAntiAliasing;
 			break;
 
+		case GLFW_KEY_B:
+			enableBands = !enableBands;
+			break;
+
+		case GLFW_KEY_I:
+			enableInteriorRectangles = !enableInteriorRectangles;
+			break;
+
+		case GLFW_KEY_V:
+			enableCostVisualization = !enableCostVisualization;
+			break;
+
+		case GLFW_KEY_O:
+			mainFontOptions.sortCurves = !mainFontOptions.sortCurves;
+			tryUpdateMainFont(mainFontFilename);
+			break;
+
+		case GLFW_KEY_M:
+			mainFontOptions.splitMonotonic = !mainFontOptions.splitMonotonic;
+			tryUpdateMainFont(mainFontFilename);
+			break;
+
+		case GLFW_KEY_G:
+			mainFontOptions.tightGeometry = !mainFontOptions.tightGeometry;
+			tryUpdateMainFont(mainFontFilename);
+			break;
+
+		case GLFW_KEY_E:
+			// Cycle through no tolerance (two quadratic curves per cubic
+			// curve) and two tolerances.
+			if (mainFontOptions.cubicTolerance <= 0.0f) {
+				mainFontOptions.cubicTolerance = 0.001f;
+			} else if (mainFontOptions.cubicTolerance <= 0.001f) {
+				mainFontOptions.cubicTolerance = 0.004f;
+			} else {
+				mainFontOptions.cubicTolerance = 0.0f;
+			}
+			tryUpdateMainFont(mainFontFilename);
+			break;
+
+		case GLFW_KEY_F:
+			switch (mainFontOptions.curveFormat) {
+				case Font::CurveFormat::FLOAT:        mainFontOptions.curveFormat = Font::CurveFormat::QUANTIZED;    break;
+				case Font::CurveFormat::QUANTIZED:    mainFontOptions.curveFormat = Font::CurveFormat::STRIP;        break;
+				case Font::CurveFormat::STRIP:        mainFontOptions.curveFormat = Font::CurveFormat::COEFFICIENTS; break;
+				case Font::CurveFormat::COEFFICIENTS: mainFontOptions.curveFormat = Font::CurveFormat::FLOAT;        break;
+			}
+			tryUpdateMainFont(mainFontFilename);
+			break;
+
 		case GLFW_KEY_0:
 			antiAliasingWindowSize = 0;
 			break;
@@ -344,6 +613,10 @@ static void dropCallback(GLFWwindow* window, int pathCount, const char* paths[])
 }
 
 int main(int argc, char* argv[]) {
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--benchmark") benchmark = true;
+	}
+
 	if (!glfwInit()) {
 		std::cerr << "ERROR: failed to initialize GLFW" << std::endl;
 		return 1;
@@ -387,6 +660,9 @@ int main(int argc, char* argv[]) {
 	glfwSetDropCallback(window, dropCallback);
 
 	glGenVertexArrays(1, &emptyVAO);
+	glGenQueries(1, &mainTextQuery);
+	mainTextBuffer = std::make_unique<TextBuffer>();
+	streamBuffer = std::make_shared<StreamBuffer>();
 
 	shaderCatalog = std::make_unique<ShaderCatalog>("shaders");
 	backgroundShader = shaderCatalog->get("background");
@@ -446,6 +722,8 @@ int main(int argc, char* argv[]) {
 			glUniformMatrix4fv(location, 1, false, glm::value_ptr(view));
 			location = glGetUniformLocation(program, "model");
 			glUniformMatrix4fv(location, 1, false, glm::value_ptr(model));
+			location = glGetUniformLocation(program, "viewportSize");
+			glUniform2f(location, (float) width, (float) height);
 
 			location = glGetUniformLocation(program, "color");
 			glUniform4f(location, 1.0f, 1.0f, 1.0f, 1.0f);
@@ -456,10 +734,37 @@ int main(int argc, char* argv[]) {
 			glUniform1i(location, enableSuperSamplingAntiAliasing);
 			location = glGetUniformLocation(program, "enableControlPointsVisualization");
 			glUniform1i(location, enableControlPointsVisualization);
+			location = glGetUniformLocation(program, "enableBands");
+			glUniform1i(location, enableBands);
+			location = glGetUniformLocation(program, "enableInteriorRectangles");
+			glUniform1i(location, enableInteriorRectangles);
+			location = glGetUniformLocation(program, "enableCostVisualization");
+			glUniform1i(location, enableCostVisualization);
+
+			if (mainTextQueryPending) {
+				GLint available = 0;
+				glGetQueryObjectiv(mainTextQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+				if (available) {
+					GLuint64 nanoseconds = 0;
+					glGetQueryObjectui64v(mainTextQuery, GL_QUERY_RESULT, &nanoseconds);
+					mainTextMilliseconds = nanoseconds / 1e6;
+					mainTextQueryPending = false;
+				}
+			}
+
+			bool startQuery = !mainTextQueryPending;
+			if (startQuery) glBeginQuery(GL_TIME_ELAPSED, mainTextQuery);
 
 			float cx = 0.5f * (bb.minX + bb.maxX);
 			float cy = 0.5f * (bb.minY + bb.maxY);
-			mainFont->draw(-cx, -cy, mainText);
+			mainTextBuffer->setText(-cx, -cy, mainText);
+			mainFont->draw(*mainTextBuffer);
+
+			if (startQuery) {
+				glEndQuery(GL_TIME_ELAPSED);
+				mainTextQueryPending = true;
+			}
+
 			glUseProgram(0);
 		}
 
@@ -467,6 +772,12 @@ int main(int argc, char* argv[]) {
 			GLuint program = fontShader->program;
 			glUseProgram(program);
 
+			// The size must be set before drawSetup, because a hinted Font
+			// uses a different store for each size.
+			float xscale, yscale;
+			glfwGetWindowContentScale(window, &xscale, &yscale);
+			helpFont->setWorldSize(std::ceil(helpFontBaseSize * yscale));
+
 			helpFont->program = program;
 			helpFont->drawSetup();
 
@@ -480,6 +791,8 @@ int main(int argc, char* argv[]) {
 			glUniformMatrix4fv(location, 1, false, glm::value_ptr(view));
 			location = glGetUniformLocation(program, "model");
 			glUniformMatrix4fv(location, 1, false, glm::value_ptr(model));
+			location = glGetUniformLocation(program, "viewportSize");
+			glUniform2f(location, (float) width, (float) height);
 
 			location = glGetUniformLocation(program, "color");
 			float r = 200, g = 35, b = 220, a = 0.8;
@@ -491,6 +804,12 @@ int main(int argc, char* argv[]) {
 			glUniform1i(location, true);
 			location = glGetUniformLocation(program, "enableControlPointsVisualization");
 			glUniform1i(location, false);
+			location = glGetUniformLocation(program, "enableBands");
+			glUniform1i(location, true);
+			location = glGetUniformLocation(program, "enableInteriorRectangles");
+			glUniform1i(location, true);
+			location = glGetUniformLocation(program, "enableCostVisualization");
+			glUniform1i(location, false);
 
 			std::stringstream stream;
 			stream << "Drag and drop a .ttf or .otf file to change the font\n";
@@ -505,27 +824,46 @@ int main(int argc, char* argv[]) {
 			stream << "(using another ray along the y-axis)\n";
 			stream << glfwGetKeyName(GLFW_KEY_S, 0) << " - reset anti-aliasing settings\n";
 			stream << glfwGetKeyName(GLFW_KEY_C, 0) << " - " << (enableControlPointsVisualization ? "disable" : "enable") << " control points\n";
+			stream << glfwGetKeyName(GLFW_KEY_B, 0) << " - " << (enableBands ? "disable" : "enable") << " bands\n";
+			stream << glfwGetKeyName(GLFW_KEY_I, 0) << " - " << (enableInteriorRectangles ? "disable" : "enable") << " interior rectangles\n";
+			stream << glfwGetKeyName(GLFW_KEY_V, 0) << " - " << (enableCostVisualization ? "disable" : "enable") << " cost visualization\n";
+			stream << glfwGetKeyName(GLFW_KEY_O, 0) << " - " << (mainFontOptions.sortCurves ? "disable" : "enable") << " sorted curves\n";
+			stream << glfwGetKeyName(GLFW_KEY_M, 0) << " - " << (mainFontOptions.splitMonotonic ? "disable" : "enable") << " monotonic curves\n";
+			stream << glfwGetKeyName(GLFW_KEY_G, 0) << " - " << (mainFontOptions.tightGeometry ? "disable" : "enable") << " tight glyph geometry\n";
+			stream << glfwGetKeyName(GLFW_KEY_E, 0) << " - change cubic curve tolerance: " << mainFontOptions.cubicTolerance << " em\n";
+			stream << glfwGetKeyName(GLFW_KEY_F, 0) << " - change curve format: " << curveFormatName(mainFontOptions.curveFormat) << "\n";
 			stream << glfwGetKeyName(GLFW_KEY_R, 0) << " - reset view\n";
 			stream << glfwGetKeyName(GLFW_KEY_H, 0) << " - toggle help\n";
+			stream << "\n";
+			stream << "main text GPU time: " << std::fixed << std::setprecision(3) << mainTextMilliseconds << " ms\n";
+
+			StreamBuffer::Statistics streamStatistics = streamBuffer->getStatistics();
+			stream << "streamed text geometry: " << streamStatistics.lastFrameBytes << " bytes, " << streamStatistics.lastFrameFenceWaitCount << " fence waits per frame\n";
 
 			std::string helpText = stream.str();
 			helpFont->prepareGlyphsForText(helpText);
 
-			float xscale, yscale;
-			glfwGetWindowContentScale(window, &xscale, &yscale);
-			helpFont->setWorldSize(std::ceil(helpFontBaseSize * yscale));
-
-			auto bb = helpFont->measure(0, 0, helpText);
-			helpFont->draw(10 - bb.minX, height - 10 - bb.maxY, helpText);
+			// Lay out the text once for measuring and drawing it.
+			helpFont->layout(helpText, helpRun);
+			const Font::BoundingBox& bb = helpRun.bounds;
+			helpFont->draw(10 - bb.minX, height - 10 - bb.maxY, helpRun);
 			glUseProgram(0);
 		}
 
 		glDisable(GL_BLEND);
 
+		// The fonts do not end the frame of the shared stream buffer.
+		if (mainFont) mainFont->endFrame();
+		if (helpFont) helpFont->endFrame();
+		streamBuffer->endFrame();
+
 		glfwSwapBuffers(window);
 	}
 
 	// Clean up OpenGL resources before termination.
+	glDeleteQueries(1, &mainTextQuery);
+	mainTextBuffer = nullptr;
+	streamBuffer = nullptr;
 	mainFont = nullptr;
 	helpFont = nullptr;
 